@@ -0,0 +1,159 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include "conf.hpp"
+
+namespace zi
+{
+
+bool conf_parse(std::string_view text, std::vector<conf_line> &out,
+                std::string &error)
+{
+    conf_line   line   = {1, {}};
+    std::string word;
+    bool        inword = false; /* set by "" as well */
+    int         lineno = 1;
+    std::size_t i, n = text.size();
+
+    auto endword = [&]
+    {
+        if (inword)
+            line.words.push_back(std::move(word));
+        word.clear();
+        inword = false;
+    };
+
+    out.clear();
+    for (i = 0; i < n; i++)
+        switch (text[i])
+        {
+        case '\n':
+            endword();
+            if (!line.words.empty())
+                out.push_back(std::move(line));
+            line.words.clear();
+            line.lineno = ++lineno;
+            break;
+        case ' ':
+        case '\t':
+        case '\r':
+            endword();
+            break;
+        case '\\':
+            if (i + 1 < n && text[i + 1] == '\n')
+            {
+                endword();
+                lineno++;
+                i++;
+            }
+            else if (i + 1 < n)
+            {
+                word += text[++i];
+                inword = true;
+            }
+            break;
+        case '#':
+            if (line.words.empty() && !inword)
+            {
+                while (i + 1 < n && text[i + 1] != '\n')
+                    i++;
+                break;
+            }
+            word += text[i];
+            inword = true;
+            break;
+        case '"':
+            for (i++; i < n && text[i] != '"' && text[i] != '\n'; i++)
+            {
+                if (text[i] == '\\' && i + 1 < n && text[i + 1] != '\n')
+                    i++;
+                word += text[i];
+            }
+            if (i == n || text[i] == '\n')
+            {
+                error = "line " + std::to_string(lineno) +
+                        ": unterminated quote";
+                return false;
+            }
+            inword = true;
+            break;
+        default:
+            word += text[i];
+            inword = true;
+        }
+    endword();
+    if (!line.words.empty())
+        out.push_back(std::move(line));
+    return true;
+}
+
+bool conf_read(const char *path, std::string &text)
+{
+    FILE  *f;
+    char   buf[8192];
+    size_t n;
+
+    if (!(f = fopen(path, "r")))
+        return false;
+    text.clear();
+    while ((n = fread(buf, 1, sizeof buf, f)) > 0)
+        text.append(buf, n);
+    n = ferror(f);
+    fclose(f);
+    if (n)
+        errno = EIO;
+    return !n;
+}
+
+conf_watch::conf_watch(std::string const &path)
+{
+#ifdef __linux__
+    std::size_t slash = path.rfind('/');
+    std::string dir   = slash == std::string::npos ? "." : path.substr(0, slash);
+
+    name_ = path.substr(slash == std::string::npos ? 0 : slash + 1);
+    if ((inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0 &&
+        inotify_add_watch(inotify_, dir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO | IN_ONLYDIR) < 0)
+    {
+        close(inotify_);
+        inotify_ = -1;
+    }
+#else
+    (void)path;
+#endif
+}
+
+conf_watch::~conf_watch()
+{
+    if (inotify_ >= 0)
+        close(inotify_);
+}
+
+bool conf_watch::changed()
+{
+    bool ret = false;
+#ifdef __linux__
+    alignas(struct inotify_event) char buf[4096];
+    struct inotify_event              *ev;
+    ssize_t                            len;
+
+    while ((len = read(inotify_, buf, sizeof buf)) > 0)
+        for (char *p = buf; p < buf + len; p += sizeof *ev + ev->len)
+        {
+            ev = reinterpret_cast<struct inotify_event *>(p);
+            if ((ev->mask & IN_Q_OVERFLOW) ||
+                (ev->len && name_ == ev->name))
+                ret = true;
+        }
+#endif
+    return ret;
+}
+
+} // namespace zi
@@ -0,0 +1,56 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zi
+{
+
+/* One line of a configuration file, split into words. */
+struct conf_line
+{
+    int                      lineno;
+    std::vector<std::string> words;
+};
+
+/* Splits a configuration file into lines of words in a single pass.
+ *
+ * Words are separated by blanks. Double quotes keep blanks inside a word and
+ * within them a backslash takes the next character literally; a backslash at
+ * the end of a line joins it with the next one. A '#' before the first word
+ * makes the line a comment, elsewhere it is an ordinary character so that
+ * colours need no quotes. On an unterminated quote false is returned and
+ * error says where. */
+bool conf_parse(std::string_view text, std::vector<conf_line> &out,
+                std::string &error);
+
+/* Reads the whole file into text; false with errno set if it cannot. */
+bool conf_read(const char *path, std::string &text);
+
+/* Tells when a file was written or replaced. The directory is watched rather
+ * than the file, as most editors save by renaming a new file over the old
+ * one; removing the file is not reported. Without inotify, or if the
+ * directory does not exist yet, fd() is -1 and nothing is reported. */
+class conf_watch
+{
+private:
+    std::string name_;
+    int         inotify_ = -1;
+
+    conf_watch(conf_watch const &)            = delete;
+    conf_watch &operator=(conf_watch const &) = delete;
+
+public:
+    explicit conf_watch(std::string const &path);
+    ~conf_watch();
+
+    int fd() const { return inotify_; }
+
+    /* Reads the pending events, true if one of them was about the file. */
+    bool changed();
+};
+
+} // namespace zi
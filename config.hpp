@@ -5,7 +5,22 @@ static const unsigned int borderpx    = 1;  /* border pixel of windows */
 static const unsigned int snap        = 32; /* snap pixel */
 static const int          showbar     = 1;  /* 0 means no bar */
 static const int          topbar      = 1;  /* 0 means bottom bar */
+static const unsigned int barfps      = 0;  /* bar redraws per second, 0 follows the monitor refresh rate */
+static const unsigned int titlerate   = 10; /* title updates per second and client */
 static const char*        fonts[]     = {"Terminus:pixelsize=20"};
+/* one codepoint per Unicode block whose fallback font is looked up in the
+ * background after startup, so that titles in these scripts draw at once */
+static const long         prewarm[]   = {
+    0x03a9, /* Greek */
+    0x0416, /* Cyrillic */
+    0x05d0, /* Hebrew */
+    0x0627, /* Arabic */
+    0x2192, /* arrows */
+    0x2605, /* miscellaneous symbols */
+    0x3042, /* Hiragana */
+    0x4e2d, /* CJK unified ideographs */
+    0xac00, /* Hangul */
+};
 static const char         dmenufont[] = "Terminus:pixelsize=20";
 static const char         col_gray1[] = "#222222"; // "#894537"
 static const char         col_gray2[] = "#444444";
@@ -43,6 +58,12 @@ static const int   resizehints =
     1; /* 1 means respect size hints in tiled resizals */
 static const int lockfullscreen =
     1; /* 1 will force focus on the fullscreen window */
+static const int smartplacement =
+    1; /* 1 places new floating windows where they overlap the least */
+static const unsigned int focusdwell =
+    40; /* ms the pointer rests on a window before it gets focus, 0 = at once */
+static const int spawnhelper =
+    0; /* 1 starts programs from a helper forked before dwm grows */
 
 // clang-format off
 
@@ -79,9 +100,21 @@ static const char* termcmd[] = {"st", NULL};
 
 // clang-format off
 
+/* autostart: an entry starts once the entries named in after are ready, which
+ * is when they are running or, with ReadyExit, when they have exited. Entries
+ * without a command run the script of that name in ~/.local/share/dwm (or
+ * ~/.dwm) if it exists. */
+static const Autostart autostart[] = {
+	/* name                     command  after                    ready */
+	{ "autostart_blocking.sh",  NULL,    NULL,                    ReadyExit },
+	{ "autostart.sh",           NULL,    "autostart_blocking.sh", ReadyStart },
+};
+
 static Key keys[] = {
 	/* modifier                     key        function        argument */
-	{ MODKEY,                       XK_p,      spawn,          {.v = dmenucmd } },
+	{ MODKEY,                       XK_p,      launchmenu,     {0} },
+	{ MODKEY|ShiftMask,             XK_p,      spawn,          {.v = dmenucmd } },
+	{ MODKEY,                       XK_w,      switchmenu,     {0} },
 	{ MODKEY|ShiftMask,             XK_Return, spawn,          {.v = termcmd } },
 	{ MODKEY,                       XK_b,      togglebar,      {0} },
 	{ MODKEY,                       XK_j,      focusstack,     {.i = +1 } },
@@ -91,6 +124,14 @@ static Key keys[] = {
 	{ MODKEY,                       XK_h,      setmfact,       {.f = -0.05} },
 	{ MODKEY,                       XK_l,      setmfact,       {.f = +0.05} },
 	{ MODKEY,                       XK_Return, zoom,           {0} },
+	{ MODKEY,                       XK_Left,   focusdir,       {.i = DirLeft } },
+	{ MODKEY,                       XK_Right,  focusdir,       {.i = DirRight } },
+	{ MODKEY,                       XK_Up,     focusdir,       {.i = DirUp } },
+	{ MODKEY,                       XK_Down,   focusdir,       {.i = DirDown } },
+	{ MODKEY|ShiftMask,             XK_Left,   movedir,        {.i = DirLeft } },
+	{ MODKEY|ShiftMask,             XK_Right,  movedir,        {.i = DirRight } },
+	{ MODKEY|ShiftMask,             XK_Up,     movedir,        {.i = DirUp } },
+	{ MODKEY|ShiftMask,             XK_Down,   movedir,        {.i = DirDown } },
 	{ MODKEY,                       XK_Tab,    view,           {0} },
 	{ MODKEY|ShiftMask,             XK_c,      killclient,     {0} },
 	{ MODKEY,                       XK_t,      setlayout,      {.v = &layouts[0]} },
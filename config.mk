@@ -14,6 +14,13 @@ X11LIB = /usr/X11R6/lib
 XINERAMALIBS  = -lXinerama
 XINERAMAFLAGS = -DXINERAMA
 
+# Xrandr (1.5) monitor hotplug, comment if you don't want it
+XRANDRLIBS  = -lXrandr
+XRANDRFLAGS = -DXRANDR
+
+# Xlib on XCB, for pipelined requests
+XCBLIBS = -lX11-xcb -lxcb
+
 # freetype
 FREETYPELIBS = -lfontconfig -lXft
 FREETYPEINC = /usr/include/freetype2
@@ -22,13 +29,13 @@ FREETYPEINC = /usr/include/freetype2
 
 # includes and libs
 INCS = -I${X11INC} -I${FREETYPEINC}
-LIBS = -L${X11LIB} -lX11 ${XINERAMALIBS} ${FREETYPELIBS}
+LIBS = -L${X11LIB} -lX11 ${XCBLIBS} ${XINERAMALIBS} ${XRANDRLIBS} ${FREETYPELIBS}
 
 # flags
-CPPPREFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS}
+CPPPREFLAGS = -D_DEFAULT_SOURCE -D_BSD_SOURCE -D_POSIX_C_SOURCE=200809L -DVERSION=\"${VERSION}\" ${XINERAMAFLAGS} ${XRANDRFLAGS}
 #CFLAGS   = -g -std=c99 -pedantic -Wall -O0 ${INCS} ${CPPFLAGS}
-CPPFLAGS   = -std=c++20 -Wall -Wno-deprecated-declarations -Wno-sign-compare -Os ${INCS} ${CPPPREFLAGS} -pedantic  -Wpedantic -Wextra
-LDFLAGS  = ${LIBS}
+CPPFLAGS   = -std=c++20 -pthread -Wall -Wno-deprecated-declarations -Wno-sign-compare -Os ${INCS} ${CPPPREFLAGS} -pedantic  -Wpedantic -Wextra
+LDFLAGS  = -pthread ${LIBS}
 
 # Solaris
 #CFLAGS = -fast ${INCS} -DVERSION=\"${VERSION}\"
@@ -11,11 +11,86 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+
+#include <climits>
+#include <cstdlib>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
 
 namespace zi
 {
 
+struct xcb_free
+{
+    void operator()(void *p) const { std::free(p); }
+};
+
+/* Replies are malloc'ed by XCB and owned by the caller. */
+template <typename T>
+using xcb_ptr = std::unique_ptr<T, xcb_free>;
+
+class display;
+
+/* The cookie of an XCB request that has been sent but whose reply is only
+ * waited for in get(), so independent requests can all be in flight before
+ * the first round trip is paid. Errors are routed to the display's error
+ * callback. A future dropped unread discards its reply. */
+template <typename Cookie, typename Reply,
+          Reply *(*ReplyFn)(xcb_connection_t *, Cookie, xcb_generic_error_t **)>
+class future
+{
+private:
+    display *display_ = nullptr;
+    Cookie   cookie_  = {};
+
+public:
+    future() = default;
+
+    future(display *d, Cookie cookie)
+        : display_(d)
+        , cookie_(cookie)
+    {
+    }
+
+    future(future const &)            = delete;
+    future &operator=(future const &) = delete;
+
+    future(future &&other) noexcept
+        : display_(std::exchange(other.display_, nullptr))
+        , cookie_(other.cookie_)
+    {
+    }
+
+    future &operator=(future &&other) noexcept
+    {
+        if (this != &other)
+        {
+            discard();
+            display_ = std::exchange(other.display_, nullptr);
+            cookie_  = other.cookie_;
+        }
+        return *this;
+    }
+
+    ~future() { discard(); }
+
+    bool valid() const { return display_ != nullptr; }
+
+    /* Waits for the reply, which is null if the request failed. */
+    xcb_ptr<Reply> get();
+
+    void discard();
+};
+
+
 class display
 {
 private:
@@ -27,6 +102,16 @@ private:
 
     Window root_window_;
 
+    /* serial ranges whose errors are expected, see ignore_errors */
+    std::vector<std::pair<unsigned long, unsigned long>> ignored_;
+
+    /* the connection underneath Xlib, shared with it and with Xft */
+    xcb_connection_t *xcb_ = nullptr;
+
+    std::function<void(xcb_generic_error_t const &)> on_error_;
+
+    unsigned long waits_ = 0; /* blocking round trips taken through here */
+
 private:
     display(display const &) = delete;
     display(display &&)      = delete;
@@ -34,6 +119,7 @@ private:
     display &operator=(display const &) = delete;
     display &operator=(display &&) = delete;
 
+public:
     void enforce_single()
     {
 
@@ -54,6 +140,7 @@ private:
         this->sync();
     }
 
+private:
     auto xset_error_handler(int (*handler)(Display *, XErrorEvent *),
                             bool and_sync = false)
     {
@@ -66,11 +153,66 @@ private:
     }
 
 public:
+    /* While alive, errors caused by the requests issued on the display are
+     * dropped by their sequence number, without a server grab or a sync.
+     * The error handler has to consult ignored(). */
+    class ignore_errors
+    {
+    private:
+        display      &d_;
+        unsigned long first_;
+
+        ignore_errors(ignore_errors const &) = delete;
+        ignore_errors &operator=(ignore_errors const &) = delete;
+
+    public:
+        explicit ignore_errors(display &d)
+            : d_(d)
+            , first_(NextRequest(d.xdisplay_))
+        {
+            /* ranges the server is done with can no longer match */
+            std::erase_if(d_.ignored_,
+                          [done = LastKnownRequestProcessed(d_.xdisplay_)](
+                              auto const &r) { return r.second < done; });
+            d_.ignored_.push_back({first_, ULONG_MAX});
+        }
+
+        ~ignore_errors()
+        {
+            for (auto it = d_.ignored_.rbegin(); it != d_.ignored_.rend(); ++it)
+                if (it->first == first_ && it->second == ULONG_MAX)
+                {
+                    it->second = NextRequest(d_.xdisplay_) - 1;
+                    break;
+                }
+        }
+    };
+
+    /* Whether the error was caused by a request issued under ignore_errors.
+     * Errors arrive in request order, so ranges before this one are done. */
+    bool ignored(XErrorEvent const *ee)
+    {
+        std::erase_if(ignored_,
+                      [ee](auto const &r) { return r.second < ee->serial; });
+        for (auto const &r : ignored_)
+            if (r.first <= ee->serial && ee->serial <= r.second)
+                return true;
+        return false;
+    }
+
     void sync(bool discard_events_on_queue = false)
     {
+        ++waits_;
         XSync(xdisplay_, discard_events_on_queue);
     }
 
+    /* For profiling: requests sent so far and round trips waited for,
+     * counting syncs and async replies but not Xlib's own getters. */
+    unsigned long requests() const { return NextRequest(xdisplay_) - 1; }
+    unsigned long waits() const { return waits_; }
+
+    void count_wait() { ++waits_; }
+
     int const &screen() const { return screen_; }
 
     int const &width() const { return width_; }
@@ -100,6 +242,8 @@ public:
         height_ = DisplayHeight(xdisplay_, screen_);
 
         root_window_ = RootWindow(xdisplay_, screen_);
+
+        xcb_ = XGetXCBConnection(xdisplay_);
     }
 
     ~display()
@@ -112,6 +256,88 @@ public:
 
 public:
     Display *xhandle() const { return xdisplay_; }
+
+    xcb_connection_t *xcb() const { return xcb_; }
+
+    /* Where the errors of async requests go; they never reach the Xlib
+     * error handler on their own. */
+    void on_error(std::function<void(xcb_generic_error_t const &)> fn)
+    {
+        on_error_ = std::move(fn);
+    }
+
+    void report(xcb_generic_error_t const &e)
+    {
+        if (on_error_)
+            on_error_(e);
+    }
+
+public:
+    /* Async requests; each returns as soon as the request is queued. */
+    using window_attributes_future =
+        future<xcb_get_window_attributes_cookie_t,
+               xcb_get_window_attributes_reply_t,
+               xcb_get_window_attributes_reply>;
+    using geometry_future =
+        future<xcb_get_geometry_cookie_t, xcb_get_geometry_reply_t,
+               xcb_get_geometry_reply>;
+    using property_future =
+        future<xcb_get_property_cookie_t, xcb_get_property_reply_t,
+               xcb_get_property_reply>;
+    using tree_future = future<xcb_query_tree_cookie_t,
+                               xcb_query_tree_reply_t, xcb_query_tree_reply>;
+
+    window_attributes_future get_window_attributes(Window w)
+    {
+        return {this, xcb_get_window_attributes(xcb_, w)};
+    }
+
+    geometry_future get_geometry(Window w)
+    {
+        return {this, xcb_get_geometry(xcb_, w)};
+    }
+
+    /* length is in 32 bit units, as with XGetWindowProperty */
+    property_future get_property(Window w, Atom property, Atom type,
+                                 std::uint32_t length)
+    {
+        return {this, xcb_get_property(xcb_, false, w, property, type, 0,
+                                       length)};
+    }
+
+    tree_future query_tree(Window w)
+    {
+        return {this, xcb_query_tree(xcb_, w)};
+    }
 };
 
+template <typename Cookie, typename Reply,
+          Reply *(*ReplyFn)(xcb_connection_t *, Cookie, xcb_generic_error_t **)>
+xcb_ptr<Reply> future<Cookie, Reply, ReplyFn>::get()
+{
+    display             *d = std::exchange(display_, nullptr);
+    xcb_generic_error_t *e = nullptr;
+    Reply               *r;
+
+    if (!d)
+        return nullptr;
+    d->count_wait();
+    r = ReplyFn(d->xcb(), cookie_, &e);
+    if (e)
+    {
+        d->report(*e);
+        std::free(e);
+    }
+    return xcb_ptr<Reply>(r);
+}
+
+template <typename Cookie, typename Reply,
+          Reply *(*ReplyFn)(xcb_connection_t *, Cookie, xcb_generic_error_t **)>
+void future<Cookie, Reply, ReplyFn>::discard()
+{
+    if (display_)
+        xcb_discard_reply(std::exchange(display_, nullptr)->xcb(),
+                          cookie_.sequence);
+}
+
 }; // namespace zi
@@ -2,12 +2,16 @@
 
 /* See LICENSE file for copyright and license details. */
 #include <X11/Xft/Xft.h>
+#include <X11/Xlib-xcb.h>
 #include <X11/Xlib.h>
+#include <bit>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <vector>
 
 #include "drw.hpp"
+#include "fontcache.hpp"
 #include "util.hpp"
 
 namespace zi
@@ -66,40 +70,39 @@ static size_t utf8decode(const char *c, long *u, size_t clen)
     return len;
 }
 
-drawable::drawable(Display *dpy, int screen, Window root, unsigned int w,
-                   unsigned int h)
+drawable::drawable(Display *dpy, int screen, Window root)
 {
-    this->dpy     = dpy;
-    this->screen  = screen;
-    this->root    = root;
-    this->w       = w;
-    this->h       = h;
-    this->drwable = XCreatePixmap(dpy, root, w, h, DefaultDepth(dpy, screen));
-    this->gc      = XCreateGC(dpy, root, 0, NULL);
+    this->dpy    = dpy;
+    this->screen = screen;
+    this->root   = root;
+    this->target = NULL;
+    this->gc     = XCreateGC(dpy, root, 0, NULL);
     XSetLineAttributes(dpy, this->gc, 1, LineSolid, CapButt, JoinMiter);
 }
 
-void drawable::resize(unsigned int w, unsigned int h)
-{
-    this->w = w;
-    this->h = h;
-    if (this->drwable)
-        XFreePixmap(this->dpy, this->drwable);
-    this->drwable = XCreatePixmap(this->dpy, this->root, w, h,
-                                  DefaultDepth(this->dpy, this->screen));
-}
-
 drawable::~drawable()
 {
-    XFreePixmap(this->dpy, this->drwable);
     XFreeGC(this->dpy, this->gc);
     fontset_free(this->fonts);
 }
 
+std::unique_ptr<zi::pixmap> drawable::pixmap_create(unsigned int w,
+                                                    unsigned int h)
+{
+    return std::make_unique<zi::pixmap>(this->dpy, this->screen, this->root,
+                                        w, h);
+}
+
+void drawable::settarget(zi::pixmap *pm)
+{
+    this->target = pm;
+}
+
 bool drawable::fontset_create(const char *fonts[], size_t fontcount)
 {
     std::shared_ptr<zi::font> cur = nullptr;
     std::shared_ptr<zi::font> ret = nullptr;
+    zi::fontcache             cache;
 
     if (!fonts)
     {
@@ -108,13 +111,21 @@ bool drawable::fontset_create(const char *fonts[], size_t fontcount)
 
     for (std::size_t i = 1; i <= fontcount; i++)
     {
-        if ((cur = xfont_create(fonts[fontcount - i], NULL)))
+        if ((cur = xfont_create(fonts[fontcount - i], NULL,
+                                cache.lookup(fonts[fontcount - i]))))
         {
+            cache.store(fonts[fontcount - i], cur->xfont()->pattern);
             cur->next = ret;
             ret       = cur;
         }
     }
-    return (this->fonts = ret) != nullptr;
+    cache.save();
+    /* a set that cannot be loaded at all leaves the current one in place */
+    if (!ret)
+        return false;
+    fontset_free(this->fonts);
+    this->fonts = ret;
+    return true;
 }
 
 unsigned int drawable::fontset_getwidth(const char *t)
@@ -127,6 +138,39 @@ unsigned int drawable::fontset_getwidth(const char *t)
     return text(0, 0, 0, 0, 0, t, 0);
 }
 
+FcPattern *drawable::fontset_fallbackbase()
+{
+    FcPattern *p;
+
+    if (!this->fonts || !this->fonts->pattern())
+        return NULL;
+    p = FcPatternDuplicate(this->fonts->pattern());
+    XftDefaultSubstitute(this->dpy, this->screen, p);
+    return p;
+}
+
+void drawable::fontset_add(long codepoint, FcPattern *match)
+{
+    std::shared_ptr<zi::font> f, last;
+
+    for (f = this->fonts; f; last = f, f = f->next)
+        if (XftCharExists(this->dpy, f->xfont(), codepoint))
+        {
+            FcPatternDestroy(match);
+            return;
+        }
+    if (!last)
+    {
+        FcPatternDestroy(match);
+        return;
+    }
+    f = xfont_create(NULL, match);
+    if (f && XftCharExists(this->dpy, f->xfont(), codepoint))
+        last->next = f;
+    else
+        xfont_free(f);
+}
+
 void drawable::fontset_free(std::shared_ptr<zi::font> const &font)
 {
     if (font)
@@ -136,8 +180,12 @@ void drawable::fontset_free(std::shared_ptr<zi::font> const &font)
     }
 }
 
+/* A resolved pattern, as kept by zi::fontcache, is opened directly and only
+ * if that fails is fontname matched by fontconfig; either way ownership of
+ * resolved passes to this function. */
 std::shared_ptr<zi::font> drawable::xfont_create(const char *fontname,
-                                                 FcPattern  *fontpattern)
+                                                 FcPattern  *fontpattern,
+                                                 FcPattern  *resolved)
 {
     XftFont   *xfont   = NULL;
     FcPattern *pattern = NULL;
@@ -149,7 +197,10 @@ std::shared_ptr<zi::font> drawable::xfont_create(const char *fontname,
          * FcNameParse; using the latter results in the desired fallback
          * behaviour whereas the former just results in missing-character
          * rectangles being drawn, at least with some fonts. */
-        if (!(xfont = XftFontOpenName(this->dpy, this->screen, fontname)))
+        if (resolved && !(xfont = XftFontOpenPattern(this->dpy, resolved)))
+            FcPatternDestroy(resolved);
+        if (!xfont &&
+            !(xfont = XftFontOpenName(this->dpy, this->screen, fontname)))
         {
             fprintf(stderr, "error, cannot load font from name: '%s'\n",
                     fontname);
@@ -226,14 +277,71 @@ void drawable::xfont_free(std::shared_ptr<zi::font> const &font)
     XftFontClose(this->dpy, font->xfont());
 }
 
+/* Parses #rgb, #rrggbb, #rrrgggbbb and #rrrrggggbbbb the way XParseColor
+ * does, the shorter forms giving the most significant bits of a channel. */
+static bool parsehex(char const *s, XRenderColor *c)
+{
+    unsigned int v[3] = {0, 0, 0};
+    size_t       n, digits, i;
+    int          d;
+
+    if (*s++ != '#')
+        return false;
+    n = strlen(s);
+    if (!n || n % 3 || n > 12)
+        return false;
+    digits = n / 3;
+    for (i = 0; i < n; i++)
+    {
+        if (s[i] >= '0' && s[i] <= '9')
+            d = s[i] - '0';
+        else if ((s[i] | 0x20) >= 'a' && (s[i] | 0x20) <= 'f')
+            d = (s[i] | 0x20) - 'a' + 10;
+        else
+            return false;
+        v[i / digits] = v[i / digits] << 4 | d;
+    }
+    c->red   = v[0] << (16 - 4 * digits);
+    c->green = v[1] << (16 - 4 * digits);
+    c->blue  = v[2] << (16 - 4 * digits);
+    c->alpha = 0xffff;
+    return true;
+}
+
+/* What XAllocColor would return on a TrueColor visual, computed locally. */
+static unsigned long truecolorpixel(Visual const *vis, XRenderColor const &c)
+{
+    auto channel = [](unsigned long mask, unsigned short value)
+    {
+        int len = std::popcount(mask);
+
+        if (!mask || len > 16)
+            return 0UL;
+        return static_cast<unsigned long>(value >> (16 - len))
+               << std::countr_zero(mask);
+    };
+
+    return channel(vis->red_mask, c.red) | channel(vis->green_mask, c.green) |
+           channel(vis->blue_mask, c.blue);
+}
+
 /* Wrapper to create color schemes. The caller (zi: 12/25/21 - it
  * doesn't have to do that anymore) has to call free(3) on the
- * returned color scheme when done using it. */
+ * returned color scheme when done using it.
+ *
+ * Hex colours never wait for the server: on TrueColor visuals the pixel is
+ * computed here and otherwise all cells of the scheme are requested before
+ * the first reply is read. Named colours still go through Xft. */
 std::unique_ptr<Clr[]> drawable::scm_create(char const *clrnames[],
                                             std::size_t clrcount)
 {
 
-    std::unique_ptr<Clr[]> ret;
+    std::unique_ptr<Clr[]>                ret;
+    Visual                              *vis;
+    Colormap                              cmap;
+    xcb_connection_t                    *conn;
+    std::vector<xcb_alloc_color_cookie_t> cookies;
+    std::vector<bool>                     parsed;
 
     // Need at least two colors for a scheme
     if (!clrnames || clrcount < 2 || !(ret = std::make_unique<Clr[]>(clrcount)))
@@ -241,14 +349,68 @@ std::unique_ptr<Clr[]> drawable::scm_create(char const *clrnames[],
         return nullptr;
     }
 
+    vis  = DefaultVisual(this->dpy, this->screen);
+    cmap = DefaultColormap(this->dpy, this->screen);
+    conn = XGetXCBConnection(this->dpy);
+    cookies.resize(clrcount);
+    parsed.resize(clrcount);
     for (std::size_t i = 0; i < clrcount; i++)
     {
-        clr_create(std::addressof(ret[i]), clrnames[i]);
+        if (!clrnames[i] || !parsehex(clrnames[i], &ret[i].color))
+            continue;
+        parsed[i] = true;
+        if (vis->c_class == TrueColor)
+            ret[i].pixel = truecolorpixel(vis, ret[i].color);
+        else
+            cookies[i] = xcb_alloc_color(conn, cmap, ret[i].color.red,
+                                         ret[i].color.green, ret[i].color.blue);
+    }
+
+    for (std::size_t i = 0; i < clrcount; i++)
+    {
+        xcb_alloc_color_reply_t *reply;
+        xcb_generic_error_t     *err = NULL;
+
+        if (!parsed[i])
+        {
+            clr_create(std::addressof(ret[i]), clrnames[i]);
+        }
+        else if (vis->c_class != TrueColor)
+        {
+            if (!(reply = xcb_alloc_color_reply(conn, cookies[i], &err)))
+            {
+                free(err);
+                zi::die("error, cannot allocate color '%s'", clrnames[i]);
+            }
+            ret[i].pixel = reply->pixel;
+            free(reply);
+        }
     }
 
     return ret;
 }
 
+/* Gives back the colormap cells of a scheme in a single request. On TrueColor
+ * visuals nothing was allocated, the pixels having been computed. */
+void drawable::scm_free(std::unique_ptr<Clr[]> const &scm, std::size_t clrcount)
+{
+    Visual               *vis = DefaultVisual(this->dpy, this->screen);
+    std::vector<uint32_t> pixels;
+
+    if (!scm || vis->c_class == TrueColor)
+    {
+        return;
+    }
+
+    for (std::size_t i = 0; i < clrcount; i++)
+    {
+        pixels.push_back(scm[i].pixel);
+    }
+    xcb_free_colors(XGetXCBConnection(this->dpy),
+                    DefaultColormap(this->dpy, this->screen), 0,
+                    pixels.size(), pixels.data());
+}
+
 int drawable::text(int x, int y, unsigned int w, unsigned int h,
                    unsigned int lpad, const char *text, int invert)
 {
@@ -267,7 +429,7 @@ int drawable::text(int x, int y, unsigned int w, unsigned int h,
     XftResult   result;
     int         charexists = 0;
 
-    if ((render && !this->scheme) || !text || !this->fonts)
+    if ((render && (!this->scheme || !this->target)) || !text || !this->fonts)
         return 0;
 
     if (!render)
@@ -278,10 +440,9 @@ int drawable::text(int x, int y, unsigned int w, unsigned int h,
     {
         XSetForeground(this->dpy, this->gc,
                        this->scheme[invert ? ColFg : ColBg].pixel);
-        XFillRectangle(this->dpy, this->drwable, this->gc, x, y, w, h);
-        d = XftDrawCreate(this->dpy, this->drwable,
-                          DefaultVisual(this->dpy, this->screen),
-                          DefaultColormap(this->dpy, this->screen));
+        XFillRectangle(this->dpy, this->target->xhandle(), this->gc, x, y, w,
+                       h);
+        d = this->target->xftdraw();
         x += lpad;
         w -= lpad;
     }
@@ -406,16 +567,15 @@ int drawable::text(int x, int y, unsigned int w, unsigned int h,
             }
         }
     }
-    if (d)
-        XftDrawDestroy(d);
-
     return x + (render ? w : 0);
 }
 
 void drawable::map(Window win, int x, int y, unsigned int w, unsigned int h)
 {
-    XCopyArea(this->dpy, this->drwable, win, this->gc, x, y, w, h, x, y);
-    XSync(this->dpy, False);
+    if (!this->target)
+        return;
+    XCopyArea(this->dpy, this->target->xhandle(), win, this->gc, x, y, w, h,
+              x, y);
 }
 
 void drawable::font_getexts(std::shared_ptr<zi::font> const &font,
@@ -437,15 +597,17 @@ void drawable::font_getexts(std::shared_ptr<zi::font> const &font,
 void drawable::rect(int x, int y, unsigned int w, unsigned int h, int filled,
                     int invert)
 {
-    if (!this->scheme)
+    if (!this->scheme || !this->target)
         return;
     XSetForeground(this->dpy, this->gc,
                    invert ? this->scheme[ColBg].pixel
                           : this->scheme[ColFg].pixel);
     if (filled)
-        XFillRectangle(this->dpy, this->drwable, this->gc, x, y, w, h);
+        XFillRectangle(this->dpy, this->target->xhandle(), this->gc, x, y, w,
+                       h);
     else
-        XDrawRectangle(this->dpy, this->drwable, this->gc, x, y, w - 1, h - 1);
+        XDrawRectangle(this->dpy, this->target->xhandle(), this->gc, x, y,
+                       w - 1, h - 1);
 }
 
 std::unique_ptr<zi::cursor> drawable::cur_create(int shape)
@@ -5,6 +5,7 @@
 #include "cursor.hpp"
 #include "display.hpp"
 #include "font.hpp"
+#include "pixmap.hpp"
 
 #include <memory>
 
@@ -34,11 +35,10 @@ namespace zi
 class drawable
 {
 public:
-    unsigned int              w, h;
     Display                  *dpy;
     int                       screen;
     Window                    root;
-    Drawable                  drwable;
+    zi::pixmap               *target;
     GC                        gc;
     Clr                      *scheme;
     std::shared_ptr<zi::font> fonts;
@@ -49,26 +49,36 @@ private:
                       unsigned int len, unsigned int *w, unsigned int *h);
 
     std::shared_ptr<zi::font> xfont_create(const char *fontname,
-                                           FcPattern  *fontpattern);
+                                           FcPattern  *fontpattern,
+                                           FcPattern  *resolved = NULL);
     void                      xfont_free(std::shared_ptr<zi::font> const &font);
 
     void clr_create(Clr *dest, char const *clrname);
 
 public:
     /* Drawable abstraction */
-    drawable(Display *dpy, int screen, Window win, unsigned int w,
-             unsigned int h);
+    drawable(Display *dpy, int screen, Window win);
     ~drawable();
 
-    void resize(unsigned int w, unsigned int h);
+    /* Pixmaps are owned by the caller, the drawable only renders into the
+     * current target */
+    std::unique_ptr<zi::pixmap> pixmap_create(unsigned int w, unsigned int h);
+    void                        settarget(zi::pixmap *pm);
 
     /* Fnt abstraction */
     bool         fontset_create(const char *fonts[], size_t fontcount);
     unsigned int fontset_getwidth(const char *text);
 
+    /* Fallback fonts resolved off the main thread: the pattern they are
+     * derived from, and adding one that covers codepoint to the chain
+     * (match is taken over either way) */
+    FcPattern *fontset_fallbackbase();
+    void       fontset_add(long codepoint, FcPattern *match);
+
     /* Colorscheme abstraction */
     // void drw_clr_create(Drw *drw, Clr *dest, const char *clrname);
     std::unique_ptr<Clr[]> scm_create(const char *clrnames[], size_t clrcount);
+    void scm_free(std::unique_ptr<Clr[]> const &scm, size_t clrcount);
 
     /* Cursor abstraction */
     std::unique_ptr<zi::cursor> cur_create(int shape);
@@ -19,16 +19,22 @@
  * client.
  *
  * Keys and tagging rules are organized as arrays and defined in config.h.
+ * The configuration file can change them at runtime, see readconfig().
  *
  * To understand everything else, start reading main().
  */
 #include <array>
+#include <bit>
 #include <clocale>
 #include <cstring>
+#include <deque>
 #include <iostream>
 #include <memory>
+#include <ranges>
 #include <string>
+#include <unordered_map>
 #include <utility>
+#include <vector>
 
 #include <X11/Xatom.h>
 #include <X11/Xlib.h>
@@ -37,12 +43,16 @@
 #include <X11/cursorfont.h>
 #include <X11/keysym.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <locale.h>
+#include <poll.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -50,9 +60,21 @@
 #ifdef XINERAMA
 #include <X11/extensions/Xinerama.h>
 #endif /* XINERAMA */
+#ifdef XRANDR
+#include <X11/extensions/Xrandr.h>
+#endif /* XRANDR */
 #include <X11/Xft/Xft.h>
 
+#include "conf.hpp"
 #include "drw.hpp"
+#include "fontwarm.hpp"
+#include "fuzzy.hpp"
+#include "pathindex.hpp"
+#include "place.hpp"
+#include "profile.hpp"
+#include "spawner.hpp"
+#include "trigram.hpp"
+#include "spatial.hpp"
 #include "util.hpp"
 
 /* macros */
@@ -85,7 +107,8 @@ enum
 enum
 {
     SchemeNorm,
-    SchemeSel
+    SchemeSel,
+    SchemeLast
 }; /* color schemes */
 enum
 {
@@ -118,6 +141,13 @@ enum
     ClkRootWin,
     ClkLast
 }; /* clicks */
+enum
+{
+    DirLeft,
+    DirRight,
+    DirUp,
+    DirDown
+}; /* directions */
 
 typedef union
 {
@@ -141,19 +171,23 @@ typedef struct Client  Client;
 
 struct Client
 {
-    char         name[256];
-    float        mina, maxa;
-    int          x, y, w, h;
-    int          oldx, oldy, oldw, oldh;
-    int          basew, baseh, incw, inch, maxw, maxh, minw, minh;
-    int          bw, oldbw;
-    unsigned int tags;
-    int          isfixed, isfloating, isurgent, neverfocus, oldstate;
-    bool         isfullscreen;
-    Client      *next;
-    Client      *snext;
-    Monitor     *mon;
-    Window       win;
+    std::string   name;
+    std::string   klass; /* WM_CLASS class and instance */
+    std::uint64_t namehash;
+    long long     titlenext; /* earliest time the title is read again */
+    int           titlepending;
+    float         mina, maxa;
+    int           x, y, w, h;
+    int           oldx, oldy, oldw, oldh;
+    int           basew, baseh, incw, inch, maxw, maxh, minw, minh;
+    int           bw, oldbw;
+    unsigned int  tags;
+    int           isfixed, isfloating, isurgent, neverfocus, oldstate, userpos;
+    bool          isfullscreen;
+    Client       *next;
+    Client       *snext;
+    Monitor      *mon;
+    Window        win;
 
     int full_height() const noexcept { return h + 2 * bw; }
     int full_width() const noexcept { return w + 2 * bw; }
@@ -173,6 +207,13 @@ typedef struct
     void (*arrange)(Monitor *);
 } Layout;
 
+typedef struct
+{
+    std::uint64_t key;    /* hash of what the segment shows */
+    int           x, w;   /* horizontal extent in the bar */
+    int           opaque; /* paints every pixel of its extent */
+} Segment;
+
 struct Monitor
 {
     char          ltsymbol[16];
@@ -190,9 +231,20 @@ struct Monitor
     Client       *clients;
     Client       *sel;
     Client       *stack;
-    Monitor      *next;
     Window        barwin;
     const Layout *lt[2];
+    Atom          rrname;      /* RandR monitor name, None without RandR */
+    float         refresh;     /* vertical refresh in Hz, 0 if unknown */
+    float         dpi;
+    int           geomchanged; /* needs a re-layout after a hotplug */
+
+    zi::spatial_index<Client *> index; /* committed client geometry */
+    int                         indexdirty;
+
+    std::unique_ptr<zi::pixmap> barpix; /* bar backing store, ww x bh */
+    std::vector<Segment>        segs;   /* what barpix currently shows */
+    long long                   barnext; /* earliest time of the next paint */
+    int                         barpending;
 };
 
 typedef struct
@@ -205,60 +257,182 @@ typedef struct
     int          monitor;
 } Rule;
 
+enum
+{
+    ReadyStart,
+    ReadyExit
+}; /* when an autostart entry lets the entries after it start */
+
+typedef struct
+{
+    const char        *name;
+    const char *const *cmd;   /* NULL runs the script called name */
+    const char        *after; /* space separated names to wait for */
+    int                ready;
+} Autostart;
+
+/* The tables the handlers look things up in. config.hpp provides the
+ * defaults and the configuration file adds to them; the strings the entries
+ * point to are owned here, so that a reload replaces all of it at once. */
+typedef struct
+{
+    std::vector<const char *>                           fonts;
+    std::array<std::array<const char *, 3>, SchemeLast> colors;
+    std::vector<Rule>                                   rules;
+    std::vector<Key>                                    keys;
+    std::vector<Button>                                 buttons;
+    std::deque<std::string>                             strings;
+    std::deque<std::vector<const char *>>               argvs;
+} Config;
+
+enum
+{
+    ArgNone,
+    ArgInt,
+    ArgDir,
+    ArgTags,
+    ArgFloat,
+    ArgLayout,
+    ArgCmd
+}; /* what follows a function name in the configuration file */
+
+typedef struct
+{
+    const char *name;
+    void (*func)(const Arg *);
+    int argtype;
+} Command;
+
+/* A one line menu over the bar of the selected monitor. While it is open the
+ * keyboard is grabbed and every key goes to overlaykey(); accept gets the
+ * chosen item, -1 if nothing matched, and what was typed. The items are
+ * fuzzy filtered unless search is set, which then lists the matches of a
+ * query itself, best first. They belong to the caller, who calls
+ * overlayitems() whenever they change while the menu is open. */
+typedef struct
+{
+    Window                            win;
+    XIM                               xim;
+    XIC                               xic; /* turns key presses into UTF-8 */
+    std::unique_ptr<zi::pixmap>       pix;
+    Monitor                          *mon;
+    const char                       *prompt;
+    std::string                       query;
+    std::vector<std::string> const   *items;
+    zi::fuzzy_filter                  filter;
+    std::vector<std::uint32_t>        found; /* the matches with search */
+    std::vector<std::uint32_t> const *matches;
+    std::size_t                       sel, first; /* indices into matches */
+    void (*accept)(int item, std::string const &query);
+    void (*search)(std::string const &query, std::vector<std::uint32_t> &out);
+    int open;
+} Overlay;
+
 /* function declarations */
 static void     applyrules(Client *c);
 static int      applysizehints(Client *c, int *x, int *y, int *w, int *h,
                                int interact);
 static void     arrange(Monitor *m);
+static void     applygeom(void);
+static std::string autostartdir(void);
 static void     arrangemon(Monitor *m);
 static void     attach(Client *c);
 static void     attachstack(Client *c);
 static void     buttonpress(XEvent *e);
 static void     cleanup(void);
 static void     cleanupmon(Monitor *mon);
+static int      confline(Config *cf, std::vector<std::string> &words,
+                         std::string &error);
+static int      confmods(std::string const &s, unsigned int *mod,
+                         std::string *rest);
+static int      conftags(std::string const &s, unsigned int *mask);
+static void     closeoverlay(void);
 static void     clientmessage(XEvent *e);
 static void     configure(Client *c);
 static void     configurenotify(XEvent *e);
 static void     configurerequest(XEvent *e);
-static Monitor *createmon(void);
+static void     foldconfigure(XConfigureRequestEvent *ev);
+static std::unique_ptr<Monitor> createmon(void);
+static std::unique_ptr<Config> defaultconfig(void);
 static void     destroynotify(XEvent *e);
 static void     detach(Client *c);
 static void     detachstack(Client *c);
 static Monitor *dirtomon(int dir);
+static zi::spatial_index<Client *> &clientindex(Monitor *m);
 static void     drawbar(Monitor *m);
+static void     dispatch(XEvent *ev);
+static void     dropbatched(int type);
 static void     drawbars(void);
+static void     paintbar(Monitor *m);
 static void     enternotify(XEvent *e);
+static void     entermon(Client *c, Monitor *m);
+static Window   eventwindow(XEvent *ev);
 static void     expose(XEvent *e);
 static void     focus(Client *c);
 static void     focusin(XEvent *e);
+static void     focusdir(const Arg *arg);
 static void     focusmon(const Arg *arg);
 static void     focusstack(const Arg *arg);
+static int      foldrepeats(XKeyEvent *ev);
 static Atom     getatomprop(Client *c, Atom prop);
 static int      getrootptr(int *x, int *y);
-static long     getstate(Window w);
 static int      gettextprop(Window w, Atom atom, char *text, unsigned int size);
 static void     grabbuttons(Client *c, int focused);
 static void     grabkeys(void);
 static void     incnmaster(const Arg *arg);
+static void     internatoms(void);
+static int      isinput(int type);
 static void     keypress(XEvent *e);
 static void     killclient(const Arg *arg);
-static void     manage(Window w, XWindowAttributes *wa);
+static void     launchaccept(int item, std::string const &query);
+static void     launchmenu(const Arg *arg);
+static void     manage(Window w, XWindowAttributes *wa,
+                       Client const *saved = nullptr);
 static void     mappingnotify(XEvent *e);
 static void     maprequest(XEvent *e);
 static void     monocle(Monitor *m);
 static void     motionnotify(XEvent *e);
+static void     movedir(const Arg *arg);
 static void     movemouse(const Arg *arg);
 static Client  *nexttiled(Client *c);
+static void     openoverlay(const char                     *prompt,
+                            std::vector<std::string> const &items,
+                            void (*accept)(int, std::string const &),
+                            void (*search)(std::string const &,
+                                           std::vector<std::uint32_t> &) =
+                                nullptr);
+static void     overlayitems(void);
+static void     overlaykey(XKeyEvent *ev);
+static void     overlayfilter(void);
+static void     paintoverlay(void);
+static void     placeclient(Client *c);
 static void     pop(Client *);
+static void     prewarmfonts(void);
+static void     prioritize(void);
+static void     profilelaunch(const char *cmd, long long us, const char *how);
+static void     profilereport(void);
 static void     propertynotify(XEvent *e);
 static void     quit(const Arg *arg);
 static Monitor *recttomon(int x, int y, int w, int h);
+static void     reapchildren(void);
+static std::unique_ptr<Config> readconfig(void);
+static void     reindexmons(void);
+static void     reloadconfig(void);
 static void     resize(Client *c, int x, int y, int w, int h, int interact);
 static void     resizeclient(Client *c, int x, int y, int w, int h);
 static void     resizemouse(const Arg *arg);
 static void     restack(Monitor *m);
+static void     restorestate(
+        std::unordered_map<Window, XWindowAttributes *> const &wins);
+#ifdef XRANDR
+static void     rrnotify(XEvent *e);
+static int      updaterandr(void);
+#endif /* XRANDR */
 static void     run(void);
+static void     unbatch(void);
+static int      runtimers(void);
 static void     runautostart(void);
+static void     savestate(void);
 static void     scan(void);
 static int      sendevent(Client *c, Atom proto);
 static void     sendmon(Client *c, Monitor *m);
@@ -273,7 +447,15 @@ static void     showhide(Client *c);
 static void     sigchld(int /* unused */);
 static void     sighup(int /* unused */);
 static void     sigterm(int /* unused */);
+static void     swapclients(Client *a, Client *b);
 static void     spawn(const Arg *arg);
+static void     switchaccept(int item, std::string const &query);
+static void     switchmenu(const Arg *arg);
+static void     switchsearch(std::string const &query,
+                             std::vector<std::uint32_t> &out);
+static pid_t    spawnargv(const char *const argv[]);
+static pid_t    spawnpath(const char *path, const char *const argv[]);
+static void     startautostart(void);
 static void     tag(const Arg *arg);
 static void     tagmon(const Arg *arg);
 static void     tile(Monitor *);
@@ -286,24 +468,24 @@ static void     unmanage(Client *c, int destroyed);
 static void     unmapnotify(XEvent *e);
 static void     updatebarpos(Monitor *m);
 static void     updatebars(void);
+static void     updateclass(Client *c, std::string *klass,
+                            std::string *instance);
 static void     updateclientlist(void);
+static void     updatewinindex(Client *c);
 static int      updategeom(void);
 static void     updatenumlockmask(void);
 static void     updatesizehints(Client *c);
 static void     updatestatus(void);
-static void     updatetitle(Client *c);
+static int      updatetitle(Client *c);
 static void     updatewindowtype(Client *c);
 static void     updatewmhints(Client *c);
 static void     view(const Arg *arg);
 static Client  *wintoclient(Window w);
 static Monitor *wintomon(Window w);
 static int      xerror(Display *dpy, XErrorEvent *ee);
-static int      xerrordummy(Display *dpy, XErrorEvent *ee);
 static void     zoom(const Arg *arg);
 
 /* variables */
-static const char autostartblocksh[] = "autostart_blocking.sh";
-static const char autostartsh[]      = "autostart.sh";
 static const char broken[]           = "broken";
 static const char dwmdir[]           = "dwm";
 static const char localshare[]       = ".local/share";
@@ -316,6 +498,10 @@ static int bh, blw = 0; /* bar geometry */
 static int lrpad;       /* sum of left and right padding for text */
 static int (*xerrorxlib)(Display *, XErrorEvent *);
 static unsigned int numlockmask = 0;
+static int          geomdirty   = 0; /* applied once the event queue drains */
+#ifdef XRANDR
+static int rrevbase = -1; /* RandR event base, -1 without RandR 1.5 */
+#endif /* XRANDR */
 
 // static void (*handler[LASTEvent])(XEvent *);
 
@@ -340,6 +526,74 @@ static void initialize_handlers()
 };
 
 static Atom wmatom[WMLast], netatom[NetLast];
+static Atom utf8string;
+static zi::profiler profiler;
+static const char  *profilepath = nullptr; /* report file, stderr if null */
+
+/* Every atom dwm uses, interned together in one request by internatoms().
+ * New atoms only need an entry here. */
+static constexpr struct
+{
+    Atom       *array;
+    int         index;
+    const char *name;
+} atomnames[] = {
+    {wmatom, WMProtocols, "WM_PROTOCOLS"},
+    {wmatom, WMDelete, "WM_DELETE_WINDOW"},
+    {wmatom, WMState, "WM_STATE"},
+    {wmatom, WMTakeFocus, "WM_TAKE_FOCUS"},
+    {netatom, NetActiveWindow, "_NET_ACTIVE_WINDOW"},
+    {netatom, NetSupported, "_NET_SUPPORTED"},
+    {netatom, NetWMName, "_NET_WM_NAME"},
+    {netatom, NetWMState, "_NET_WM_STATE"},
+    {netatom, NetWMCheck, "_NET_SUPPORTING_WM_CHECK"},
+    {netatom, NetWMFullscreen, "_NET_WM_STATE_FULLSCREEN"},
+    {netatom, NetWMWindowType, "_NET_WM_WINDOW_TYPE"},
+    {netatom, NetWMWindowTypeDialog, "_NET_WM_WINDOW_TYPE_DIALOG"},
+    {netatom, NetClientList, "_NET_CLIENT_LIST"},
+    {&utf8string, 0, "UTF8_STRING"},
+};
+
+/* whether atomnames has exactly one entry for each of array[0..n) */
+static constexpr bool atomscovered(Atom *array, int n)
+{
+    int i, k, total = 0;
+
+    for (i = 0; i < n; i++)
+    {
+        k = 0;
+        for (auto const &a : atomnames)
+            k += a.array == array && a.index == i;
+        if (k != 1)
+            return false;
+    }
+    for (auto const &a : atomnames)
+        total += a.array == array;
+    return total == n;
+}
+
+static_assert(atomscovered(wmatom, WMLast), "atomnames misses a WM atom");
+static_assert(atomscovered(netatom, NetLast), "atomnames misses an EWMH atom");
+/* events read in one go by run(); handled entries have their type set to 0 */
+static std::vector<XEvent> batch;
+static std::size_t         batchpos;
+static const std::size_t   batchmax = 256; /* bounds how long work can wait */
+static int  titlespending = 0;
+/* focus on enter waits until the pointer rests, see focusdwell */
+static Client   *dwellclient;
+static Monitor  *dwellmon;
+static long long dwellat;
+static int       dwelling = 0;
+/* progress of the autostart entries, indexed like autostart */
+enum
+{
+    AutoWaiting,
+    AutoRunning,
+    AutoReady
+};
+static std::vector<int>   autostate;
+static std::vector<pid_t> autopid;
+static int childpipe[2] = {-1, -1}; /* written to by sigchld, read by run() */
 static int  restart = 0;
 static int  running = 1;
 
@@ -351,51 +605,80 @@ static std::unique_ptr<std::unique_ptr<Clr[]>[]> scheme;
 static std::unique_ptr<zi::display> display;
 
 static std::unique_ptr<zi::drawable> drw;
-
-static Monitor *mons, *selmon;
+static std::unique_ptr<zi::fontwarmer> fontwarm;
+static std::unique_ptr<zi::path_index> pathindex;
+static std::unique_ptr<Config>         conf;
+static std::string                     conffile;
+static std::unique_ptr<zi::conf_watch> confwatch;
+static zi::spawner                     launcher;
+
+/* monitor table indexed by Monitor::num */
+static std::vector<std::unique_ptr<Monitor>> mons;
+static zi::region_index<Monitor *>           monindex;
+static Monitor                              *selmon;
 static Window   wmcheckwin;
+static Overlay  overlay;
+/* client titles and classes, for searching windows by name */
+static zi::trigram_index<Window>                winindex;
+static std::vector<Window>                      switchwins;
+static std::vector<std::string>                 switchitems;
+static std::unordered_map<Window, std::uint32_t> switchpos;
 
 /* configuration, allows nested code to access above variables */
 #include "config.hpp"
 
 /* compile-time check if all tags fit into an unsigned int bit array. */
 static_assert(std::size(tags) < 32);
+static_assert(std::size(colors) == SchemeLast);
+
+/* the functions the configuration file can bind, by name */
+static const Command commands[] = {
+    {"focusdir", focusdir, ArgDir},
+    {"focusmon", focusmon, ArgInt},
+    {"focusstack", focusstack, ArgInt},
+    {"incnmaster", incnmaster, ArgInt},
+    {"killclient", killclient, ArgNone},
+    {"launchmenu", launchmenu, ArgNone},
+    {"movedir", movedir, ArgDir},
+    {"movemouse", movemouse, ArgNone},
+    {"quit", quit, ArgInt},
+    {"resizemouse", resizemouse, ArgNone},
+    {"setlayout", setlayout, ArgLayout},
+    {"setmfact", setmfact, ArgFloat},
+    {"spawn", spawn, ArgCmd},
+    {"switchmenu", switchmenu, ArgNone},
+    {"tag", tag, ArgTags},
+    {"tagmon", tagmon, ArgInt},
+    {"togglebar", togglebar, ArgNone},
+    {"togglefloating", togglefloating, ArgNone},
+    {"toggletag", toggletag, ArgTags},
+    {"toggleview", toggleview, ArgTags},
+    {"view", view, ArgTags},
+    {"zoom", zoom, ArgNone},
+};
 
 /* function implementations */
 void applyrules(Client *c)
 {
-    const char  *klass, *instance;
-    unsigned int i;
-    const Rule  *r;
-    Monitor     *m;
-    XClassHint   ch = {nullptr, nullptr};
+    std::string klass, instance;
 
     /* rule matching */
     c->isfloating = 0;
     c->tags       = 0;
-    XGetClassHint(display->xhandle(), c->win, &ch);
-    klass    = ch.res_class ? ch.res_class : broken;
-    instance = ch.res_name ? ch.res_name : broken;
+    updateclass(c, &klass, &instance);
 
-    for (i = 0; i < std::size(rules); i++)
+    for (auto const &r : conf->rules)
     {
-        r = &rules[i];
-        if ((!r->title || strstr(c->name, r->title)) &&
-            (!r->klass || strstr(klass, r->klass)) &&
-            (!r->instance || strstr(instance, r->instance)))
+        if ((!r.title || strstr(c->name.c_str(), r.title)) &&
+            (!r.klass || strstr(klass.c_str(), r.klass)) &&
+            (!r.instance || strstr(instance.c_str(), r.instance)))
         {
-            c->isfloating = r->isfloating;
-            c->tags |= r->tags;
-            for (m = mons; m && m->num != r->monitor; m = m->next)
-                ;
-            if (m)
-                c->mon = m;
+            c->isfloating = r.isfloating;
+            c->tags |= r.tags;
+            if (r.monitor >= 0 && std::cmp_less(r.monitor, mons.size()))
+                c->mon = mons[r.monitor].get();
         }
     }
-    if (ch.res_class)
-        XFree(ch.res_class);
-    if (ch.res_name)
-        XFree(ch.res_name);
     c->tags =
         c->tags & TAGMASK ? c->tags & TAGMASK : c->mon->tagset[c->mon->seltags];
 }
@@ -472,21 +755,97 @@ int applysizehints(Client *c, int *x, int *y, int *w, int *h, int interact)
     return *x != c->x || *y != c->y || *w != c->w || *h != c->h;
 }
 
-void arrange(Monitor *m)
+/* index of the autostart entry named [p, q), or std::size(autostart) */
+static std::size_t autostartfind(const char *p, const char *q)
 {
-    if (m)
-        showhide(m->stack);
+    std::size_t i;
+
+    for (i = 0; i < std::size(autostart); i++)
+        if (!strncmp(autostart[i].name, p, q - p) && !autostart[i].name[q - p])
+            break;
+    return i;
+}
+
+/* Steps *p to the next name of a space separated list, ending at *q;
+ * false at the end of the list. */
+static bool autostartnext(const char **p, const char **q)
+{
+    if (!*p)
+        return false;
+    *p += strspn(*p, " ");
+    *q = *p + strcspn(*p, " ");
+    return *q > *p;
+}
+
+/* $XDG_DATA_HOME/dwm, ~/.local/share/dwm or, if that does not exist,
+ * ~/.dwm; empty without $HOME */
+std::string autostartdir(void)
+{
+    const char *home, *xdgdatahome;
+    std::string dir;
+    struct stat sb;
+
+    if (!(home = getenv("HOME")))
+        /* this is almost impossible */
+        return dir;
+    if ((xdgdatahome = getenv("XDG_DATA_HOME")) && *xdgdatahome)
+        dir = std::string(xdgdatahome) + "/" + dwmdir;
     else
-        for (m = mons; m; m = m->next)
-            showhide(m->stack);
+        dir = std::string(home) + "/" + localshare + "/" + dwmdir;
+    if (!(stat(dir.c_str(), &sb) == 0 && S_ISDIR(sb.st_mode)))
+        dir = std::string(home) + "/." + dwmdir;
+    return dir;
+}
+
+void arrange(Monitor *m)
+{
     if (m)
     {
+        m->indexdirty = 1;
+        showhide(m->stack);
         arrangemon(m);
         restack(m);
     }
     else
-        for (m = mons; m; m = m->next)
-            arrangemon(m);
+    {
+        for (auto &mon : mons)
+        {
+            mon->indexdirty = 1;
+            showhide(mon->stack);
+        }
+        for (auto &mon : mons)
+            arrangemon(mon.get());
+    }
+}
+
+/* Applies a screen layout change once the event queue has drained, so that a
+ * burst of hotplug events costs one pass, and only over the monitors whose
+ * geometry actually changed. */
+void applygeom(void)
+{
+    Client *c;
+
+    geomdirty = 0;
+    if (!updategeom())
+        return;
+    updatebars();
+    for (auto &m : mons)
+    {
+        if (!m->geomchanged)
+            continue;
+        for (c = m->clients; c; c = c->next)
+            if (c->isfullscreen)
+                resizeclient(c, m->mx, m->my, m->mw, m->mh);
+        XMoveResizeWindow(display->xhandle(), m->barwin, m->wx, m->by, m->ww,
+                          bh);
+    }
+    focus(nullptr);
+    for (auto &m : mons)
+        if (m->geomchanged)
+        {
+            m->geomchanged = 0;
+            arrange(m.get());
+        }
 }
 
 void arrangemon(Monitor *m)
@@ -498,14 +857,16 @@ void arrangemon(Monitor *m)
 
 void attach(Client *c)
 {
-    c->next         = c->mon->clients;
-    c->mon->clients = c;
+    c->next            = c->mon->clients;
+    c->mon->clients    = c;
+    c->mon->indexdirty = 1;
 }
 
 void attachstack(Client *c)
 {
-    c->snext      = c->mon->stack;
-    c->mon->stack = c;
+    c->snext           = c->mon->stack;
+    c->mon->stack      = c;
+    c->mon->indexdirty = 1;
 }
 
 void buttonpress(XEvent *e)
@@ -516,6 +877,12 @@ void buttonpress(XEvent *e)
     Monitor             *m;
     XButtonPressedEvent *ev = &e->xbutton;
 
+    dwelling = 0; /* a click or a binding overrides the pointer */
+    if (overlay.open)
+    {
+        closeoverlay();
+        return;
+    }
     click = ClkRootWin;
     /* focus monitor if necessary */
     if ((m = wintomon(ev->window)) && m != selmon)
@@ -554,35 +921,33 @@ void buttonpress(XEvent *e)
         XAllowEvents(display->xhandle(), ReplayPointer, CurrentTime);
         click = ClkClientWin;
     }
-    for (i = 0; i < std::size(buttons); i++)
-        if (click == buttons[i].click && buttons[i].func &&
-            buttons[i].button == ev->button &&
-            CLEANMASK(buttons[i].mask) == CLEANMASK(ev->state))
-            buttons[i].func(click == ClkTagBar && buttons[i].arg.i == 0
-                                ? &arg
-                                : &buttons[i].arg);
+    for (auto const &b : conf->buttons)
+        if (click == b.click && b.func && b.button == ev->button &&
+            CLEANMASK(b.mask) == CLEANMASK(ev->state))
+            b.func(click == ClkTagBar && b.arg.i == 0 ? &arg : &b.arg);
 }
 
 void cleanup(void)
 {
-    Arg      a   = {.ui = static_cast<unsigned int>(~0)};
-    Layout   foo = {"", nullptr};
-    Monitor *m;
-    size_t   i;
+    Arg    a   = {.ui = static_cast<unsigned int>(~0)};
+    Layout foo = {"", nullptr};
+    size_t i;
 
     view(&a);
     selmon->lt[selmon->sellt] = &foo;
-    for (m = mons; m; m = m->next)
+    for (auto &m : mons)
         while (m->stack)
             unmanage(m->stack, 0);
     XUngrabKey(display->xhandle(), AnyKey, AnyModifier, display->root_window());
-    while (mons)
-        cleanupmon(mons);
+    while (!mons.empty())
+        cleanupmon(mons.back().get());
     for (i = 0; i < CurLast; i++)
         drw->cur_free(cursors[i]);
     // for (i = 0; i < std::size(colors); i++)
     //     free(scheme[i]);
     XDestroyWindow(display->xhandle(), wmcheckwin);
+    fontwarm.reset();
+    confwatch.reset();
     // drw_free(drw);
     display->sync();
     XSetInputFocus(display->xhandle(), PointerRoot, RevertToPointerRoot,
@@ -593,19 +958,27 @@ void cleanup(void)
 
 void cleanupmon(Monitor *mon)
 {
-    Monitor *m;
+    int i, num = mon->num;
 
-    if (mon == mons)
-        mons = mons->next;
-    else
-    {
-        for (m = mons; m && m->next != mon; m = m->next)
-            ;
-        m->next = mon->next;
-    }
     XUnmapWindow(display->xhandle(), mon->barwin);
     XDestroyWindow(display->xhandle(), mon->barwin);
-    free(mon);
+    if (dwellmon == mon)
+        dwelling = 0;
+    if (overlay.mon == mon)
+        closeoverlay();
+    mons.erase(mons.begin() + num);
+    for (i = num; std::cmp_less(i, mons.size()); i++)
+        mons[i]->num = i;
+    reindexmons();
+}
+
+void closeoverlay(void)
+{
+    if (!overlay.open)
+        return;
+    overlay.open = 0;
+    XUngrabKeyboard(display->xhandle(), CurrentTime);
+    XUnmapWindow(display->xhandle(), overlay.win);
 }
 
 void clientmessage(XEvent *e)
@@ -631,6 +1004,290 @@ void clientmessage(XEvent *e)
     }
 }
 
+zi::spatial_index<Client *> &clientindex(Monitor *m)
+{
+    Client *c;
+
+    if (m->indexdirty)
+    {
+        /* floating clients first, they shadow the tiled ones below them */
+        m->index.clear();
+        for (c = m->stack; c; c = c->snext)
+            if (ISVISIBLE(c) && (c->isfloating || !m->lt[m->sellt]->arrange))
+                m->index.insert(
+                    c, {c->x, c->y, c->full_width(), c->full_height()});
+        for (c = m->stack; c; c = c->snext)
+            if (ISVISIBLE(c) && !c->isfloating && m->lt[m->sellt]->arrange)
+                m->index.insert(
+                    c, {c->x, c->y, c->full_width(), c->full_height()});
+        m->index.build();
+        m->indexdirty = 0;
+    }
+    return m->index;
+}
+
+/* Adds one line of the configuration file to cf. The lines are
+ *
+ *   font NAME                          a font, tried after the earlier ones
+ *   color norm|sel FG BG BORDER        the colours of a scheme
+ *   rule CLASS INSTANCE TITLE TAGS FLOATING MONITOR
+ *   bind MODS+KEY FUNCTION [ARG...]    replaces a binding of the same keys
+ *   unbind MODS+KEY
+ *   button CLICK MODS+N FUNCTION [ARG...]
+ *   clear fonts|rules|keys|buttons     drops the entries so far
+ *
+ * where "-" in a rule matches anything, TAGS is "all" or a list like 1,3 and
+ * CLICK is one of tagbar, ltsymbol, status, title, client or root. Returns 0
+ * with error set if the line is not understood. */
+int confline(Config *cf, std::vector<std::string> &words, std::string &error)
+{
+    static const char *const clicks[] = {"tagbar", "ltsymbol", "status",
+                                         "title",  "client",   "root"};
+    static const char *const dirs[]   = {"left", "right", "up", "down"};
+
+    auto          &w      = words;
+    const Command *cmd    = nullptr;
+    KeySym         keysym = NoSymbol;
+    unsigned int   mod = 0, click = 0, button = 0;
+    std::size_t    i, k, n, first;
+    std::string    key;
+    char          *end;
+    Arg            arg = {0};
+    XColor         xc;
+    Rule           r;
+
+    /* the entries keep the string, words gives it up */
+    auto keep = [cf](std::string &str)
+    { return cf->strings.emplace_back(std::move(str)).c_str(); };
+
+    if (w[0] == "font" && w.size() == 2)
+    {
+        cf->fonts.push_back(keep(w[1]));
+        return 1;
+    }
+    if (w[0] == "color" && w.size() == 5)
+    {
+        if (w[1] != "norm" && w[1] != "sel")
+        {
+            error = "no scheme " + w[1];
+            return 0;
+        }
+        i = w[1] == "norm" ? SchemeNorm : SchemeSel;
+        for (k = 0; k < 3; k++)
+        {
+            /* a colour that cannot be allocated would be fatal later */
+            if (!XParseColor(display->xhandle(),
+                             DefaultColormap(display->xhandle(),
+                                             display->screen()),
+                             w[k + 2].c_str(), &xc))
+            {
+                error = "no colour " + w[k + 2];
+                return 0;
+            }
+            cf->colors[i][k] = keep(w[k + 2]);
+        }
+        return 1;
+    }
+    if (w[0] == "rule" && w.size() == 7)
+    {
+        r.klass      = w[1] == "-" ? nullptr : keep(w[1]);
+        r.instance   = w[2] == "-" ? nullptr : keep(w[2]);
+        r.title      = w[3] == "-" ? nullptr : keep(w[3]);
+        r.isfloating = w[5] == "1";
+        r.monitor    = strtol(w[6].c_str(), &end, 10);
+        if (!conftags(w[4], &r.tags) || *end || (w[5] != "0" && w[5] != "1"))
+        {
+            error = "bad rule";
+            return 0;
+        }
+        cf->rules.push_back(r);
+        return 1;
+    }
+    if (w[0] == "clear" && w.size() == 2)
+    {
+        if (w[1] == "fonts")
+            cf->fonts.clear();
+        else if (w[1] == "rules")
+            cf->rules.clear();
+        else if (w[1] == "keys")
+            cf->keys.clear();
+        else if (w[1] == "buttons")
+            cf->buttons.clear();
+        else
+        {
+            error = "cannot clear " + w[1];
+            return 0;
+        }
+        return 1;
+    }
+
+    if ((w[0] == "bind" && w.size() >= 3) ||
+        (w[0] == "unbind" && w.size() == 2))
+    {
+        if (!confmods(w[1], &mod, &key) ||
+            (keysym = XStringToKeysym(key.c_str())) == NoSymbol)
+        {
+            error = "no key " + w[1];
+            return 0;
+        }
+        /* cleared entries are dropped once the whole file is read */
+        for (auto &e : cf->keys)
+            if (e.mod == mod && e.keysym == keysym)
+                e.func = nullptr;
+        if (w[0] == "unbind")
+            return 1;
+        first = 2;
+    }
+    else if (w[0] == "button" && w.size() >= 4)
+    {
+        for (click = 0; click < std::size(clicks); click++)
+            if (w[1] == clicks[click])
+                break;
+        if (click == std::size(clicks))
+        {
+            error = "no click " + w[1];
+            return 0;
+        }
+        if (!confmods(w[2], &mod, &key) || key.size() != 1 || key[0] < '1' ||
+            key[0] > '5')
+        {
+            error = "no button " + w[2];
+            return 0;
+        }
+        button = key[0] - '0';
+        for (auto &e : cf->buttons)
+            if (e.click == click && e.mask == mod && e.button == button)
+                e.func = nullptr;
+        first = 3;
+    }
+    else
+    {
+        error = "cannot make sense of " + w[0];
+        return 0;
+    }
+
+    for (auto const &c : commands)
+        if (w[first] == c.name)
+            cmd = &c;
+    if (!cmd)
+    {
+        error = "no function " + w[first];
+        return 0;
+    }
+    n     = w.size() - first - 1;
+    end   = nullptr;
+    error = std::string(cmd->name) + ": bad argument";
+    switch (cmd->argtype)
+    {
+    case ArgNone:
+        if (n)
+            return 0;
+        break;
+    case ArgInt:
+        if (n > 1 || (n && (arg.i = strtol(w[first + 1].c_str(), &end, 10),
+                            *end)))
+            return 0;
+        break;
+    case ArgDir:
+        for (i = 0; n == 1 && i < std::size(dirs); i++)
+            if (w[first + 1] == dirs[i])
+                break;
+        if (n != 1 || i == std::size(dirs))
+            return 0;
+        arg.i = DirLeft + i;
+        break;
+    case ArgTags:
+        if (n > 1 || (n && !conftags(w[first + 1], &arg.ui)))
+            return 0;
+        break;
+    case ArgFloat:
+        if (n != 1 ||
+            (arg.f = strtof(w[first + 1].c_str(), &end), *end))
+            return 0;
+        break;
+    case ArgLayout:
+        for (i = 0; n == 1 && i < std::size(layouts); i++)
+            if (w[first + 1] == layouts[i].symbol)
+                break;
+        if (n > 1 || (n && i == std::size(layouts)))
+            return 0;
+        arg.v = n ? &layouts[i] : nullptr;
+        break;
+    case ArgCmd:
+    {
+        if (!n)
+            return 0;
+        auto &argv = cf->argvs.emplace_back();
+        for (i = first + 1; i < w.size(); i++)
+            argv.push_back(keep(w[i]));
+        argv.push_back(nullptr);
+        arg.v = argv.data();
+        break;
+    }
+    }
+    error.clear();
+    if (w[0] == "bind")
+        cf->keys.push_back({mod, keysym, cmd->func, arg});
+    else
+        cf->buttons.push_back({click, mod, button, cmd->func, arg});
+    return 1;
+}
+
+/* Splits "Mod+Shift+x" into the modifier mask and what follows the last
+ * '+'. Mod stands for MODKEY, Alt for Mod1 and Super for Mod4. */
+int confmods(std::string const &s, unsigned int *mod, std::string *rest)
+{
+    static const struct
+    {
+        const char  *name;
+        unsigned int mask;
+    } names[] = {
+        {"Mod", MODKEY},         {"Shift", ShiftMask}, {"Control", ControlMask},
+        {"Ctrl", ControlMask},   {"Alt", Mod1Mask},    {"Super", Mod4Mask},
+        {"Mod1", Mod1Mask},      {"Mod2", Mod2Mask},   {"Mod3", Mod3Mask},
+        {"Mod4", Mod4Mask},      {"Mod5", Mod5Mask},
+    };
+    std::size_t i, j, k;
+
+    *mod = 0;
+    for (i = 0; (j = s.find('+', i)) != std::string::npos && j + 1 < s.size();
+         i = j + 1)
+    {
+        for (k = 0; k < std::size(names); k++)
+            if (!s.compare(i, j - i, names[k].name))
+                break;
+        if (k == std::size(names))
+            return 0;
+        *mod |= names[k].mask;
+    }
+    *rest = s.substr(i);
+    return !rest->empty();
+}
+
+/* Parses "all", "-" for none or a comma separated list of tag numbers. */
+int conftags(std::string const &s, unsigned int *mask)
+{
+    const char *p = s.c_str();
+    char       *end;
+    long        t;
+
+    *mask = 0;
+    if (s == "all" || s == "-")
+    {
+        *mask = s == "all" ? ~0u : 0;
+        return 1;
+    }
+    for (;; p = end + 1)
+    {
+        t = strtol(p, &end, 10);
+        if (end == p || t < 1 || std::cmp_greater(t, std::size(tags)))
+            return 0;
+        *mask |= 1u << (t - 1);
+        if (*end != ',')
+            return !*end;
+    }
+}
+
 void configure(Client *c)
 {
     XConfigureEvent ce;
@@ -652,32 +1309,17 @@ void configure(Client *c)
 
 void configurenotify(XEvent *e)
 {
-    Monitor         *m;
-    Client          *c;
     XConfigureEvent *ev = &e->xconfigure;
-    int              dirty;
 
-    /* TODO: updategeom handling sucks, needs to be simplified */
     if (ev->window == display->root_window())
     {
-        dirty = (sw != ev->width || sh != ev->height);
-        sw    = ev->width;
-        sh    = ev->height;
-        if (updategeom() || dirty)
-        {
-            drw->resize(sw, bh);
-            updatebars();
-            for (m = mons; m; m = m->next)
-            {
-                for (c = m->clients; c; c = c->next)
-                    if (c->isfullscreen)
-                        resizeclient(c, m->mx, m->my, m->mw, m->mh);
-                XMoveResizeWindow(display->xhandle(), m->barwin, m->wx, m->by,
-                                  m->ww, bh);
-            }
-            focus(nullptr);
-            arrange(nullptr);
-        }
+#ifdef XRANDR
+        if (rrevbase >= 0)
+            XRRUpdateConfiguration(e);
+#endif /* XRANDR */
+        sw        = ev->width;
+        sh        = ev->height;
+        geomdirty = 1;
     }
 }
 
@@ -685,7 +1327,7 @@ void configurerequest(XEvent *e)
 {
     Client                 *c;
     Monitor                *m;
-    XConfigureRequestEvent *ev = &e->xconfigurerequest;
+    XConfigureRequestEvent *ev = &e->xconfigurerequest, req;
     XWindowChanges          wc;
 
     if ((c = wintoclient(ev->window)))
@@ -694,6 +1336,9 @@ void configurerequest(XEvent *e)
             c->bw = ev->border_width;
         else if (c->isfloating || !selmon->lt[selmon->sellt]->arrange)
         {
+            req = *ev;
+            ev  = &req;
+            foldconfigure(ev);
             m = c->mon;
             if (ev->value_mask & CWX)
             {
@@ -724,6 +1369,7 @@ void configurerequest(XEvent *e)
             if ((ev->value_mask & (CWX | CWY)) &&
                 !(ev->value_mask & (CWWidth | CWHeight)))
                 configure(c);
+            m->indexdirty = 1;
             if (ISVISIBLE(c))
                 XMoveResizeWindow(display->xhandle(), c->win, c->x, c->y, c->w,
                                   c->h);
@@ -742,14 +1388,50 @@ void configurerequest(XEvent *e)
         wc.stack_mode   = ev->detail;
         XConfigureWindow(display->xhandle(), ev->window, ev->value_mask, &wc);
     }
-    display->sync();
 }
 
-Monitor *createmon(void)
+/* Folds the later ConfigureRequests for the same window in the current batch
+ * into ev, so that a burst of moves and resizes is applied and answered once.
+ * Folding stops at the first other event for the window, at border width
+ * changes, which take a different path, and at input, which may change how
+ * the window is laid out. */
+void foldconfigure(XConfigureRequestEvent *ev)
 {
-    Monitor *m;
+    std::size_t             i;
+    XEvent                 *e;
+    XConfigureRequestEvent *r;
+
+    for (i = batchpos + 1; i < batch.size(); i++)
+    {
+        e = &batch[i];
+        if (e->type == KeyPress || e->type == ButtonPress)
+            break;
+        if (!e->type || eventwindow(e) != ev->window)
+            continue;
+        r = &e->xconfigurerequest;
+        if (e->type != ConfigureRequest || r->value_mask & CWBorderWidth)
+            break;
+        if (r->value_mask & CWX)
+            ev->x = r->x;
+        if (r->value_mask & CWY)
+            ev->y = r->y;
+        if (r->value_mask & CWWidth)
+            ev->width = r->width;
+        if (r->value_mask & CWHeight)
+            ev->height = r->height;
+        if (r->value_mask & CWSibling)
+            ev->above = r->above;
+        if (r->value_mask & CWStackMode)
+            ev->detail = r->detail;
+        ev->value_mask |= r->value_mask;
+        e->type = 0;
+    }
+}
+
+std::unique_ptr<Monitor> createmon(void)
+{
+    auto m = std::make_unique<Monitor>();
 
-    m            = zi::safe_calloc<Monitor>(1);
     m->tagset[0] = m->tagset[1] = 1;
     m->mfact                    = mfact;
     m->nmaster                  = nmaster;
@@ -757,10 +1439,28 @@ Monitor *createmon(void)
     m->topbar                   = topbar;
     m->lt[0]                    = &layouts[0];
     m->lt[1]                    = &layouts[1 % std::size(layouts)];
+    m->dpi                      = display->width() * 25.4f /
+             std::max(1, DisplayWidthMM(display->xhandle(), display->screen()));
     strncpy(m->ltsymbol, layouts[0].symbol, sizeof m->ltsymbol);
     return m;
 }
 
+/* The configuration of config.hpp alone. */
+std::unique_ptr<Config> defaultconfig(void)
+{
+    auto        cf = std::make_unique<Config>();
+    std::size_t i;
+
+    cf->fonts.assign(std::begin(fonts), std::end(fonts));
+    for (i = 0; i < SchemeLast; i++)
+        std::copy_n(colors[i], 3, cf->colors[i].begin());
+    /* Key and Button cannot be assigned, only copied */
+    cf->rules   = std::vector<Rule>(std::begin(rules), std::end(rules));
+    cf->keys    = std::vector<Key>(std::begin(keys), std::end(keys));
+    cf->buttons = std::vector<Button>(std::begin(buttons), std::end(buttons));
+    return cf;
+}
+
 void destroynotify(XEvent *e)
 {
     Client              *c;
@@ -776,7 +1476,8 @@ void detach(Client *c)
 
     for (tc = &c->mon->clients; *tc && *tc != c; tc = &(*tc)->next)
         ;
-    *tc = c->next;
+    *tc                = c->next;
+    c->mon->indexdirty = 1;
 }
 
 void detachstack(Client *c)
@@ -785,7 +1486,8 @@ void detachstack(Client *c)
 
     for (tc = &c->mon->stack; *tc && *tc != c; tc = &(*tc)->snext)
         ;
-    *tc = c->snext;
+    *tc                = c->snext;
+    c->mon->indexdirty = 1;
 
     if (c == c->mon->sel)
     {
@@ -797,37 +1499,66 @@ void detachstack(Client *c)
 
 Monitor *dirtomon(int dir)
 {
-    Monitor *m = nullptr;
+    std::size_t n = mons.size();
 
-    if (dir > 0)
+    return mons[(selmon->num + (dir > 0 ? 1 : n - 1)) % n].get();
+}
+
+/* Bars are painted at most once per frame: the first request paints right
+ * away, later ones within the frame interval are merged into a single paint
+ * when the interval ends. */
+void drawbar(Monitor *m)
+{
+    long long now = zi::monotonic_ms();
+    float     fps = barfps ? barfps : m->refresh > 0 ? m->refresh : 60;
+
+    if (now < m->barnext)
     {
-        if (!(m = selmon->next))
-            m = mons;
+        m->barpending = 1;
+        return;
     }
-    else if (selmon == mons)
-        for (m = mons; m->next; m = m->next)
-            ;
-    else
-        for (m = mons; m->next != selmon; m = m->next)
-            ;
-    return m;
+    m->barpending = 0;
+    m->barnext    = now + static_cast<long long>(1000 / fps);
+    paintbar(m);
 }
 
-void drawbar(Monitor *m)
+/* The bar is retained in the monitor's pixmap as a row of segments: the
+ * status, one per tag, the layout symbol, the title and the floating
+ * indicator, in drawing order. Each is keyed on what it shows and only those
+ * whose key or geometry changed are rendered again, together with the later
+ * segments they would paint over and, for segments that do not cover their
+ * whole area, the earlier ones underneath. Only the span that was rendered is
+ * copied to the bar window. */
+void paintbar(Monitor *m)
 {
-    int          x, w, tw = 0;
+    enum
+    {
+        SegStatus,
+        SegTags,
+        SegLayout = SegTags + std::size(tags),
+        SegTitle,
+        SegFloat,
+        SegLast
+    };
+
+    static std::vector<Segment> segs(SegLast);
+    std::array<int, SegLast>    dirty;
+
+    int          x, w, tw = 0, x0 = m->ww, x1 = 0, again;
     int          boxs = drw->fonts->full_height() / 9;
     int          boxw = drw->fonts->full_height() / 6 + 2;
-    unsigned int i, occ = 0, urg = 0;
+    unsigned int i, j, occ = 0, urg = 0;
     Client      *c;
 
-    /* draw status first so it can be overdrawn by tags later */
-    if (m == selmon)
-    { /* status is only drawn on selected monitor */
-        drw->setscheme(scheme[SchemeNorm]);
-        tw = TEXTW(stext) - lrpad + 2; /* 2px right padding */
-        drw->text(m->ww - tw, 0, tw, bh, 0, stext, 0);
+    /* each bar renders into its own pixmap, created on first use and
+     * recreated when the bar width changes */
+    if (!m->barpix || m->barpix->width() != static_cast<unsigned int>(m->ww) ||
+        m->barpix->height() != static_cast<unsigned int>(bh))
+    {
+        m->barpix = drw->pixmap_create(m->ww, bh);
+        m->segs.clear();
     }
+    drw->settarget(m->barpix.get());
 
     for (c = m->clients; c; c = c->next)
     {
@@ -835,47 +1566,132 @@ void drawbar(Monitor *m)
         if (c->isurgent)
             urg |= c->tags;
     }
-    x = 0;
+
+    /* status is only drawn on selected monitor */
+    if (m == selmon)
+        tw = TEXTW(stext) - lrpad + 2; /* 2px right padding */
+    segs[SegStatus] = {zi::fnv1a(stext), m->ww - tw, tw, 1};
+    x               = 0;
     for (i = 0; i < std::size(tags); i++)
     {
-        w = TEXTW(tags[i]);
-        drw->setscheme(
-            scheme[m->tagset[m->seltags] & 1 << i ? SchemeSel : SchemeNorm]);
-        drw->text(x, 0, w, bh, lrpad / 2, tags[i], urg & 1 << i);
-        if (occ & 1 << i)
-            drw->rect(x + boxs, boxs, boxw, boxw,
-                      m == selmon && selmon->sel && selmon->sel->tags & 1 << i,
-                      urg & 1 << i);
+        w                 = TEXTW(tags[i]);
+        segs[SegTags + i] = {
+            zi::fnv1a((m->tagset[m->seltags] >> i & 1) |
+                      (urg >> i & 1) << 1 | (occ >> i & 1) << 2 |
+                      (m == selmon && selmon->sel &&
+                       selmon->sel->tags >> i & 1)
+                          << 3),
+            x, w, 1};
         x += w;
     }
-    w = blw = TEXTW(m->ltsymbol);
-    drw->setscheme(scheme[SchemeNorm]);
-    x = drw->text(x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
-
+    w = blw         = TEXTW(m->ltsymbol);
+    segs[SegLayout] = {zi::fnv1a(m->ltsymbol), x, w, 1};
+    x += w;
     if ((w = m->ww - tw - x) > bh)
     {
-        if (m->sel)
+        segs[SegTitle] = {m->sel ? zi::fnv1a(m->sel->name,
+                                             zi::fnv1a(1 + (m == selmon)))
+                                 : 0,
+                          x, w, 1};
+        segs[SegFloat] = {zi::fnv1a(m->sel && m->sel->isfloating
+                                        ? 1 + m->sel->isfixed
+                                        : 0),
+                          x + boxs, boxw, 0};
+    }
+    else
+        segs[SegTitle] = segs[SegFloat] = {0, x, 0, 1};
+
+    for (i = 0; i < SegLast; i++)
+        dirty[i] = m->segs.size() != SegLast || segs[i].key != m->segs[i].key ||
+                   segs[i].x != m->segs[i].x || segs[i].w != m->segs[i].w;
+    do
+        for (again = 0, i = 0; i < SegLast; i++)
+            for (j = 0; dirty[i] && j < SegLast; j++)
+                if (!dirty[j] && (j > i || !segs[i].opaque) &&
+                    segs[i].x < segs[j].x + segs[j].w &&
+                    segs[j].x < segs[i].x + segs[i].w)
+                    dirty[j] = again = 1;
+    while (again);
+
+    for (i = 0; i < SegLast; i++)
+    {
+        if (!dirty[i] || !segs[i].w)
+            continue;
+        x  = segs[i].x;
+        w  = segs[i].w;
+        x0 = std::min(x0, x);
+        x1 = std::max(x1, x + w);
+        if (i == SegStatus)
+        {
+            drw->setscheme(scheme[SchemeNorm]);
+            drw->text(x, 0, w, bh, 0, stext, 0);
+        }
+        else if (i < SegLayout)
+        {
+            j = i - SegTags;
+            drw->setscheme(
+                scheme[m->tagset[m->seltags] & 1 << j ? SchemeSel
+                                                      : SchemeNorm]);
+            drw->text(x, 0, w, bh, lrpad / 2, tags[j], urg & 1 << j);
+            if (occ & 1 << j)
+                drw->rect(x + boxs, boxs, boxw, boxw,
+                          m == selmon && selmon->sel &&
+                              selmon->sel->tags & 1 << j,
+                          urg & 1 << j);
+        }
+        else if (i == SegLayout)
+        {
+            drw->setscheme(scheme[SchemeNorm]);
+            drw->text(x, 0, w, bh, lrpad / 2, m->ltsymbol, 0);
+        }
+        else if (i == SegTitle && m->sel)
         {
             drw->setscheme(scheme[m == selmon ? SchemeSel : SchemeNorm]);
-            drw->text(x, 0, w, bh, lrpad / 2, m->sel->name, 0);
-            if (m->sel->isfloating)
-                drw->rect(x + boxs, boxs, boxw, boxw, m->sel->isfixed, 0);
+            drw->text(x, 0, w, bh, lrpad / 2, m->sel->name.c_str(), 0);
         }
-        else
+        else if (i == SegTitle)
         {
             drw->setscheme(scheme[SchemeNorm]);
             drw->rect(x, 0, w, bh, 1, 1);
         }
+        else if (m->sel && m->sel->isfloating)
+        {
+            drw->setscheme(scheme[m == selmon ? SchemeSel : SchemeNorm]);
+            drw->rect(x, boxs, w, boxw, m->sel->isfixed, 0);
+        }
     }
-    drw->map(m->barwin, 0, 0, m->ww, bh);
+    m->segs.swap(segs);
+    segs.resize(SegLast);
+    if (x0 < x1)
+        drw->map(m->barwin, x0, 0, x1 - x0, bh);
 }
 
-void drawbars(void)
+void dispatch(XEvent *ev)
 {
-    Monitor *m;
+    if (ev->type < LASTEvent && handler[ev->type])
+        handler[ev->type](ev); /* call handler */
+#ifdef XRANDR
+    else if (rrevbase >= 0 && (ev->type == rrevbase + RRScreenChangeNotify ||
+                               ev->type == rrevbase + RRNotify))
+        rrnotify(ev);
+#endif /* XRANDR */
+}
+
+/* Drops the events of the given type that are still waiting in the batch, the
+ * counterpart of XCheckMaskEvent for what run() has already read. */
+void dropbatched(int type)
+{
+    std::size_t i;
 
-    for (m = mons; m; m = m->next)
-        drawbar(m);
+    for (i = batchpos + 1; i < batch.size(); i++)
+        if (batch[i].type == type)
+            batch[i].type = 0;
+}
+
+void drawbars(void)
+{
+    for (auto &m : mons)
+        drawbar(m.get());
 }
 
 void enternotify(XEvent *e)
@@ -889,23 +1705,90 @@ void enternotify(XEvent *e)
         return;
     c = wintoclient(ev->window);
     m = c ? c->mon : wintomon(ev->window);
-    if (m != selmon)
+    if (m == selmon && (!c || c == selmon->sel))
     {
-        unfocus(selmon->sel, 1);
-        selmon = m;
-    }
-    else if (!c || c == selmon->sel)
+        dwelling = 0; /* back where the focus already is */
         return;
+    }
+    if (focusdwell)
+    {
+        dwelling    = 1;
+        dwellclient = c;
+        dwellmon    = m;
+        dwellat     = zi::monotonic_ms() + focusdwell;
+        return;
+    }
+    entermon(c, m);
+}
+
+/* Focuses c, which the pointer entered, or the monitor m if c is null. */
+void entermon(Client *c, Monitor *m)
+{
+    if (m != selmon)
+    {
+        unfocus(selmon->sel, 1);
+        selmon = m;
+    }
     focus(c);
 }
 
+/* The window an event is about; for structure events selected on the parent
+ * this is the child, not the window the event was reported on. */
+Window eventwindow(XEvent *ev)
+{
+    switch (ev->type)
+    {
+    case ConfigureRequest:
+        return ev->xconfigurerequest.window;
+    case MapRequest:
+        return ev->xmaprequest.window;
+    case ConfigureNotify:
+        return ev->xconfigure.window;
+    case CreateNotify:
+        return ev->xcreatewindow.window;
+    case DestroyNotify:
+        return ev->xdestroywindow.window;
+    case MapNotify:
+        return ev->xmap.window;
+    case UnmapNotify:
+        return ev->xunmap.window;
+    case ReparentNotify:
+        return ev->xreparent.window;
+    case GravityNotify:
+        return ev->xgravity.window;
+    case CirculateNotify:
+        return ev->xcirculate.window;
+    case CirculateRequest:
+        return ev->xcirculaterequest.window;
+    default:
+        return ev->xany.window;
+    }
+}
+
 void expose(XEvent *e)
 {
     Monitor      *m;
     XExposeEvent *ev = &e->xexpose;
 
-    if (ev->count == 0 && (m = wintomon(ev->window)))
-        drawbar(m);
+    if (ev->window == overlay.win)
+    {
+        if (overlay.open && overlay.pix)
+        {
+            drw->settarget(overlay.pix.get());
+            drw->map(overlay.win, ev->x, ev->y, ev->width, ev->height);
+        }
+        return;
+    }
+    if (!(m = wintomon(ev->window)))
+        return;
+    if (m->barpix && !m->segs.empty())
+    {
+        /* the bar is retained, so repair just the exposed area */
+        drw->settarget(m->barpix.get());
+        drw->map(m->barwin, ev->x, ev->y, ev->width, ev->height);
+    }
+    else if (ev->count == 0)
+        paintbar(m);
 }
 
 void focus(Client *c)
@@ -939,6 +1822,30 @@ void focus(Client *c)
     drawbars();
 }
 
+static void dirvec(int dir, int *dx, int *dy)
+{
+    *dx = dir == DirLeft ? -1 : dir == DirRight ? 1 : 0;
+    *dy = dir == DirUp ? -1 : dir == DirDown ? 1 : 0;
+}
+
+void focusdir(const Arg *arg)
+{
+    int     dx, dy;
+    Client *c, *sel = selmon->sel;
+
+    if (!sel || (sel->isfullscreen && lockfullscreen))
+        return;
+    dirvec(arg->i, &dx, &dy);
+    c = clientindex(selmon).nearest(
+        {sel->x, sel->y, sel->full_width(), sel->full_height()}, dx, dy,
+        [sel](Client *t) { return t != sel; });
+    if (c)
+    {
+        focus(c);
+        restack(selmon);
+    }
+}
+
 /* there are some broken focus acquiring clients needing extra handling */
 void focusin(XEvent *e)
 {
@@ -952,7 +1859,7 @@ void focusmon(const Arg *arg)
 {
     Monitor *m;
 
-    if (!mons->next)
+    if (mons.size() < 2)
         return;
     if ((m = dirtomon(arg->i)) == selmon)
         return;
@@ -961,29 +1868,35 @@ void focusmon(const Arg *arg)
     focus(nullptr);
 }
 
+/* Moves the focus arg->i visible clients down (or up) the stack. */
 void focusstack(const Arg *arg)
 {
-    Client *c = nullptr, *i;
+    Client *c, *i, *p;
+    int     n;
 
     if (!selmon->sel || (selmon->sel->isfullscreen && lockfullscreen))
         return;
-    if (arg->i > 0)
+    for (c = selmon->sel, n = std::abs(arg->i); c && n > 0; c = p, n--)
     {
-        for (c = selmon->sel->next; c && !ISVISIBLE(c); c = c->next)
-            ;
-        if (!c)
-            for (c = selmon->clients; c && !ISVISIBLE(c); c = c->next)
+        p = nullptr;
+        if (arg->i > 0)
+        {
+            for (p = c->next; p && !ISVISIBLE(p); p = p->next)
                 ;
-    }
-    else
-    {
-        for (i = selmon->clients; i != selmon->sel; i = i->next)
-            if (ISVISIBLE(i))
-                c = i;
-        if (!c)
-            for (; i; i = i->next)
+            if (!p)
+                for (p = selmon->clients; p && !ISVISIBLE(p); p = p->next)
+                    ;
+        }
+        else
+        {
+            for (i = selmon->clients; i != c; i = i->next)
                 if (ISVISIBLE(i))
-                    c = i;
+                    p = i;
+            if (!p)
+                for (; i; i = i->next)
+                    if (ISVISIBLE(i))
+                        p = i;
+        }
     }
     if (c)
     {
@@ -1019,24 +1932,6 @@ int getrootptr(int *x, int *y)
                          &dummy, x, y, &di, &di, &dui);
 }
 
-long getstate(Window w)
-{
-    int            format;
-    long           result = -1;
-    unsigned char *p      = nullptr;
-    unsigned long  n, extra;
-    Atom           real;
-
-    if (XGetWindowProperty(display->xhandle(), w, wmatom[WMState], 0L, 2L,
-                           false, wmatom[WMState], &real, &format, &n, &extra,
-                           (unsigned char **)&p) != Success)
-        return -1;
-    if (n != 0)
-        result = *p;
-    XFree(p);
-    return result;
-}
-
 int gettextprop(Window w, Atom atom, char *text, unsigned int size)
 {
     char        **list = nullptr;
@@ -1069,7 +1964,7 @@ void grabbuttons(Client *c, int focused)
 {
     updatenumlockmask();
     {
-        unsigned int i, j;
+        unsigned int j;
         unsigned int modifiers[] = {0, LockMask, numlockmask,
                                     numlockmask | LockMask};
         XUngrabButton(display->xhandle(), AnyButton, AnyModifier, c->win);
@@ -1077,11 +1972,11 @@ void grabbuttons(Client *c, int focused)
             XGrabButton(display->xhandle(), AnyButton, AnyModifier, c->win,
                         false, BUTTONMASK, GrabModeSync, GrabModeSync, None,
                         None);
-        for (i = 0; i < std::size(buttons); i++)
-            if (buttons[i].click == ClkClientWin)
+        for (auto const &b : conf->buttons)
+            if (b.click == ClkClientWin)
                 for (j = 0; j < std::size(modifiers); j++)
-                    XGrabButton(display->xhandle(), buttons[i].button,
-                                buttons[i].mask | modifiers[j], c->win, false,
+                    XGrabButton(display->xhandle(), b.button,
+                                b.mask | modifiers[j], c->win, false,
                                 BUTTONMASK, GrabModeAsync, GrabModeSync, None,
                                 None);
     }
@@ -1091,19 +1986,19 @@ void grabkeys(void)
 {
     updatenumlockmask();
     {
-        unsigned int i, j;
+        unsigned int j;
         unsigned int modifiers[] = {0, LockMask, numlockmask,
                                     numlockmask | LockMask};
         KeyCode      code;
 
         XUngrabKey(display->xhandle(), AnyKey, AnyModifier,
                    display->root_window());
-        for (i = 0; i < std::size(keys); i++)
-            if ((code = XKeysymToKeycode(display->xhandle(), keys[i].keysym)))
+        for (auto const &k : conf->keys)
+            if ((code = XKeysymToKeycode(display->xhandle(), k.keysym)))
                 for (j = 0; j < std::size(modifiers); j++)
-                    XGrabKey(display->xhandle(), code,
-                             keys[i].mod | modifiers[j], display->root_window(),
-                             true, GrabModeAsync, GrabModeAsync);
+                    XGrabKey(display->xhandle(), code, k.mod | modifiers[j],
+                             display->root_window(), true, GrabModeAsync,
+                             GrabModeAsync);
     }
 }
 
@@ -1113,6 +2008,41 @@ void incnmaster(const Arg *arg)
     arrange(selmon);
 }
 
+/* Interns all of atomnames with a single round trip. */
+void internatoms(void)
+{
+    std::size_t i;
+    const char *names[std::size(atomnames)];
+    Atom        atoms[std::size(atomnames)];
+
+    for (i = 0; i < std::size(atomnames); i++)
+        names[i] = atomnames[i].name;
+    if (!XInternAtoms(display->xhandle(), const_cast<char **>(names),
+                      std::size(atomnames), false, atoms))
+        die("dwm: cannot intern atoms");
+    for (i = 0; i < std::size(atomnames); i++)
+        atomnames[i].array[atomnames[i].index] = atoms[i];
+}
+
+/* Events that come straight from the user; keyboard mapping changes count as
+ * well, as later key presses depend on them. */
+int isinput(int type)
+{
+    switch (type)
+    {
+    case KeyPress:
+    case KeyRelease:
+    case ButtonPress:
+    case ButtonRelease:
+    case MotionNotify:
+    case EnterNotify:
+    case MappingNotify:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
 #ifdef XINERAMA
 static int isuniquegeom(XineramaScreenInfo *unique, size_t n,
                         XineramaScreenInfo *info)
@@ -1125,18 +2055,60 @@ static int isuniquegeom(XineramaScreenInfo *unique, size_t n,
 }
 #endif /* XINERAMA */
 
-void keypress(XEvent *e)
+/* Consumes the autorepeats of ev that directly follow it in the batch and
+ * returns how many key presses were folded. */
+int foldrepeats(XKeyEvent *ev)
 {
-    unsigned int i;
-    KeySym       keysym;
-    XKeyEvent   *ev;
+    std::size_t i;
+    int         n = 0;
+    XKeyEvent  *k;
+
+    for (i = batchpos + 1; i < batch.size(); i++)
+    {
+        k = &batch[i].xkey;
+        if (!batch[i].type)
+            continue;
+        if ((batch[i].type != KeyPress && batch[i].type != KeyRelease) ||
+            k->keycode != ev->keycode ||
+            CLEANMASK(k->state) != CLEANMASK(ev->state))
+            break;
+        n += batch[i].type == KeyPress;
+        batch[i].type = 0;
+    }
+    return n;
+}
 
-    ev     = &e->xkey;
+void keypress(XEvent *e)
+{
+    int        n;
+    KeySym     keysym;
+    XKeyEvent *ev;
+    Arg        arg;
+
+    ev       = &e->xkey;
+    dwelling = 0; /* only grabbed keys get here, all of them deliberate */
+    if (overlay.open)
+    {
+        overlaykey(ev);
+        return;
+    }
     keysym = XKeycodeToKeysym(display->xhandle(), (KeyCode)ev->keycode, 0);
-    for (i = 0; i < std::size(keys); i++)
-        if (keysym == keys[i].keysym &&
-            CLEANMASK(keys[i].mod) == CLEANMASK(ev->state) && keys[i].func)
-            keys[i].func(&(keys[i].arg));
+    for (auto const &k : conf->keys)
+        if (keysym == k.keysym && CLEANMASK(k.mod) == CLEANMASK(ev->state) &&
+            k.func)
+        {
+            arg = k.arg;
+            /* held down layout keys are applied once per batch with the
+             * accumulated amount instead of once per autorepeat */
+            if (k.func == setmfact && arg.f < 1.0)
+            {
+                n     = 1 + foldrepeats(ev);
+                arg.f = std::clamp(arg.f * n, -0.9f, 0.9f);
+            }
+            else if (k.func == focusstack)
+                arg.i *= 1 + foldrepeats(ev);
+            k.func(&arg);
+        }
 }
 
 void killclient(const Arg *)
@@ -1145,23 +2117,54 @@ void killclient(const Arg *)
         return;
     if (!sendevent(selmon->sel, wmatom[WMDelete]))
     {
-        XGrabServer(display->xhandle());
-        XSetErrorHandler(xerrordummy);
+        /* the client may be gone by the time the server gets to this */
+        zi::display::ignore_errors guard(*display);
         XSetCloseDownMode(display->xhandle(), DestroyAll);
         XKillClient(display->xhandle(), selmon->sel->win);
-        display->sync();
-        XSetErrorHandler(xerror);
-        XUngrabServer(display->xhandle());
     }
 }
 
-void manage(Window w, XWindowAttributes *wa)
+/* Runs the chosen program, or what was typed if it has arguments or nothing
+ * matched; the latter goes through the shell like with dmenu_run. */
+void launchaccept(int item, std::string const &query)
+{
+    const char *shell = getenv("SHELL");
+    const char *argv[4];
+    Arg         arg;
+
+    if (item >= 0 && query.find(' ') == std::string::npos)
+    {
+        argv[0] = (*overlay.items)[item].c_str();
+        argv[1] = nullptr;
+    }
+    else if (query.find_first_not_of(' ') != std::string::npos)
+    {
+        argv[0] = shell && *shell ? shell : "/bin/sh";
+        argv[1] = "-c";
+        argv[2] = query.c_str();
+        argv[3] = nullptr;
+    }
+    else
+        return;
+    arg.v = argv;
+    spawn(&arg);
+}
+
+void launchmenu(const Arg *)
+{
+    openoverlay("run", pathindex->names(), launchaccept);
+}
+
+/* With saved, the window was managed by the dwm that restarted into this one
+ * and gets its monitor, tags, geometry and floating state back; arranging
+ * and focusing is then left to restorestate(). */
+void manage(Window w, XWindowAttributes *wa, Client const *saved)
 {
     Client        *c, *t = nullptr;
     Window         trans = None;
     XWindowChanges wc;
 
-    c      = zi::safe_calloc<Client>(1);
+    c      = new Client();
     c->win = w;
     /* geometry */
     c->x = c->oldx = wa->x;
@@ -1171,17 +2174,25 @@ void manage(Window w, XWindowAttributes *wa)
     c->oldbw       = wa->border_width;
 
     updatetitle(c);
-    if (XGetTransientForHint(display->xhandle(), w, &trans) &&
-        (t = wintoclient(trans)))
+    if (saved)
+    {
+        c->mon   = saved->mon;
+        c->tags  = saved->tags;
+        c->klass = saved->klass;
+    }
+    else if (XGetTransientForHint(display->xhandle(), w, &trans) &&
+             (t = wintoclient(trans)))
     {
         c->mon  = t->mon;
         c->tags = t->tags;
+        updateclass(c, nullptr, nullptr);
     }
     else
     {
         c->mon = selmon;
         applyrules(c);
     }
+    updatewinindex(c);
 
     if (c->x + c->full_width() > c->mon->mx + c->mon->mw)
         c->x = c->mon->mx + c->mon->mw - c->full_width();
@@ -1195,21 +2206,43 @@ void manage(Window w, XWindowAttributes *wa)
                                ? bh
                                : c->mon->my);
     c->bw = borderpx;
+    if (saved)
+    {
+        /* hidden clients sit off screen, the saved geometry is the real
+         * one, as are the border and fullscreen state */
+        c->x            = saved->x;
+        c->y            = saved->y;
+        c->w            = saved->w;
+        c->h            = saved->h;
+        c->oldx         = saved->oldx;
+        c->oldy         = saved->oldy;
+        c->oldw         = saved->oldw;
+        c->oldh         = saved->oldh;
+        c->bw           = saved->bw;
+        c->oldbw        = saved->oldbw;
+        c->isfloating   = saved->isfloating;
+        c->isfullscreen = saved->isfullscreen;
+        c->oldstate     = saved->oldstate;
+    }
 
     wc.border_width = c->bw;
     XConfigureWindow(display->xhandle(), w, CWBorderWidth, &wc);
     XSetWindowBorder(display->xhandle(), w,
                      scheme[SchemeNorm][ColBorder].pixel);
     configure(c); /* propagates border_width, if size doesn't change */
-    updatewindowtype(c);
+    if (!saved)
+        updatewindowtype(c);
     updatesizehints(c);
     updatewmhints(c);
     XSelectInput(display->xhandle(), w,
                  EnterWindowMask | FocusChangeMask | PropertyChangeMask |
                      StructureNotifyMask);
     grabbuttons(c, 0);
-    if (!c->isfloating)
+    if (!c->isfloating && !saved)
         c->isfloating = c->oldstate = trans != None || c->isfixed;
+    if (smartplacement && c->isfloating && !c->isfullscreen && !c->userpos &&
+        wa->map_state != IsViewable && !saved)
+        placeclient(c);
     if (c->isfloating)
         XRaiseWindow(display->xhandle(), c->win);
     attach(c);
@@ -1217,6 +2250,8 @@ void manage(Window w, XWindowAttributes *wa)
     XChangeProperty(display->xhandle(), display->root_window(),
                     netatom[NetClientList], XA_WINDOW, 32, PropModeAppend,
                     (unsigned char *)&(c->win), 1);
+    if (saved)
+        return;
     XMoveResizeWindow(display->xhandle(), c->win, c->x + 2 * sw, c->y, c->w,
                       c->h); /* some windows require this */
     setclientstate(c, NormalState);
@@ -1281,6 +2316,61 @@ void motionnotify(XEvent *e)
     mon = m;
 }
 
+/* Slides one axis of a floating client towards dir: up against the nearest
+ * neighbour t, past it when already touching, or to the work area edge. */
+static int slide(int pos, int size, int dir, int lo, int hi, Client *t,
+                 int tpos, int tsize)
+{
+    int to;
+
+    if (dir > 0)
+    {
+        to = (t ? tpos : hi) - size;
+        if (to <= pos && t)
+            to = tpos + tsize;
+    }
+    else
+    {
+        to = t ? tpos + tsize : lo;
+        if (to >= pos && t)
+            to = tpos - size;
+    }
+    return std::clamp(to, lo, std::max(lo, hi - size));
+}
+
+void movedir(const Arg *arg)
+{
+    int      dx, dy, nx, ny;
+    Client  *c = selmon->sel, *t;
+    Monitor *m = selmon;
+
+    if (!c || c->isfullscreen)
+        return;
+    dirvec(arg->i, &dx, &dy);
+    if (c->isfloating || !m->lt[m->sellt]->arrange)
+    {
+        t  = clientindex(m).nearest(
+            {c->x, c->y, c->full_width(), c->full_height()}, dx, dy,
+            [c](Client *o) { return o != c; });
+        nx = c->x;
+        ny = c->y;
+        if (dx)
+            nx = slide(c->x, c->full_width(), dx, m->wx, m->wx + m->ww, t,
+                       t ? t->x : 0, t ? t->full_width() : 0);
+        else
+            ny = slide(c->y, c->full_height(), dy, m->wy, m->wy + m->wh, t,
+                       t ? t->y : 0, t ? t->full_height() : 0);
+        resize(c, nx, ny, c->w, c->h, 1);
+    }
+    else if ((t = clientindex(m).nearest(
+                  {c->x, c->y, c->full_width(), c->full_height()}, dx, dy,
+                  [c](Client *o) { return o != c && !o->isfloating; })))
+    {
+        swapclients(c, t);
+        arrange(m);
+    }
+}
+
 void movemouse(const Arg *)
 {
     int      x, y, ocx, ocy, nx, ny;
@@ -1293,6 +2383,7 @@ void movemouse(const Arg *)
         return;
     if (c->isfullscreen) /* no support moving fullscreen windows by mouse */
         return;
+    unbatch(); /* the drag loop below reads from the X queue */
     restack(selmon);
     ocx = c->x;
     ocy = c->y;
@@ -1371,6 +2462,261 @@ Client *nexttiled(Client *c)
     return c;
 }
 
+/* The first paint happens before returning, so the menu shows up with the
+ * next flush. */
+void openoverlay(const char *prompt, std::vector<std::string> const &items,
+                 void (*accept)(int, std::string const &),
+                 void (*search)(std::string const &,
+                                std::vector<std::uint32_t> &))
+{
+    XSetWindowAttributes wa{};
+    Monitor             *m = selmon;
+    int                  y = m->topbar ? m->my : m->my + m->mh - bh;
+
+    wa.background_pixmap = ParentRelative;
+    wa.event_mask        = ExposureMask;
+    wa.override_redirect = true;
+    if (overlay.open ||
+        XGrabKeyboard(display->xhandle(), display->root_window(), False,
+                      GrabModeAsync, GrabModeAsync,
+                      CurrentTime) != GrabSuccess)
+        return;
+    if (!overlay.win)
+    {
+        overlay.win = XCreateWindow(
+            display->xhandle(), display->root_window(), m->mx, y, m->mw, bh,
+            0, display->default_depth(), CopyFromParent,
+            display->default_visual(),
+            CWOverrideRedirect | CWBackPixmap | CWEventMask, &wa);
+        if ((overlay.xim = XOpenIM(display->xhandle(), nullptr, nullptr,
+                                   nullptr)))
+            overlay.xic = XCreateIC(overlay.xim, XNInputStyle,
+                                    XIMPreeditNothing | XIMStatusNothing,
+                                    XNClientWindow, overlay.win,
+                                    XNFocusWindow, overlay.win, nullptr);
+    }
+    else
+        XMoveResizeWindow(display->xhandle(), overlay.win, m->mx, y, m->mw,
+                          bh);
+    overlay.mon    = m;
+    overlay.prompt = prompt;
+    overlay.accept = accept;
+    overlay.search = search;
+    overlay.items  = &items;
+    overlay.query.clear();
+    if (!search)
+        overlay.filter.assign(*overlay.items);
+    overlayfilter();
+    overlay.open = 1;
+    XMapRaised(display->xhandle(), overlay.win);
+    paintoverlay();
+}
+
+void overlayfilter(void)
+{
+    if (overlay.search)
+    {
+        overlay.search(overlay.query, overlay.found);
+        overlay.matches = &overlay.found;
+    }
+    else
+        overlay.matches = &overlay.filter.update(overlay.query);
+    overlay.sel = overlay.first = 0;
+}
+
+/* Takes up the items again after the caller changed them, keeping what was
+ * typed. */
+void overlayitems(void)
+{
+    if (!overlay.open)
+        return;
+    if (!overlay.search)
+        overlay.filter.assign(*overlay.items);
+    overlayfilter();
+    paintoverlay();
+}
+
+void overlaykey(XKeyEvent *ev)
+{
+    char        buf[64];
+    KeySym      ksym   = NoSymbol;
+    Status      status = XLookupNone;
+    int         n, item;
+    std::string query;
+
+    /* the query is UTF-8 like everything that is drawn; without an input
+     * method only ASCII can be typed */
+    if (overlay.xic)
+        n = Xutf8LookupString(overlay.xic, ev, buf, sizeof buf, &ksym,
+                              &status);
+    else
+    {
+        n = XLookupString(ev, buf, sizeof buf, &ksym, nullptr);
+        if (n > 0 && static_cast<unsigned char>(buf[0]) >= 0x80)
+            n = 0;
+    }
+    if (status == XBufferOverflow || status == XLookupKeySym)
+        n = 0;
+    if (ev->state & ControlMask)
+        switch (ksym)
+        {
+        case XK_bracketleft:
+        case XK_g:
+            ksym = XK_Escape;
+            break;
+        case XK_h:
+            ksym = XK_BackSpace;
+            break;
+        case XK_n:
+            ksym = XK_Right;
+            break;
+        case XK_p:
+            ksym = XK_Left;
+            break;
+        case XK_j:
+        case XK_m:
+            ksym = XK_Return;
+            break;
+        case XK_u:
+            overlay.query.clear();
+            overlayfilter();
+            paintoverlay();
+            return;
+        default:
+            return;
+        }
+    switch (ksym)
+    {
+    case XK_Escape:
+        closeoverlay();
+        return;
+    case XK_Return:
+    case XK_KP_Enter:
+        item  = overlay.matches->empty()
+                    ? -1
+                    : static_cast<int>((*overlay.matches)[overlay.sel]);
+        query = overlay.query;
+        closeoverlay();
+        overlay.accept(item, query);
+        return;
+    case XK_BackSpace:
+        if (overlay.query.empty())
+            return;
+        /* a whole UTF-8 sequence at a time */
+        while (overlay.query.size() > 1 &&
+               (overlay.query.back() & 0xc0) == 0x80)
+            overlay.query.pop_back();
+        overlay.query.pop_back();
+        overlayfilter();
+        break;
+    case XK_Tab:
+        /* a search may not find its own items again by their text */
+        if (overlay.search || overlay.matches->empty())
+            return;
+        overlay.query = (*overlay.items)[(*overlay.matches)[overlay.sel]];
+        overlayfilter();
+        break;
+    case XK_Right:
+    case XK_Down:
+        if (overlay.sel + 1 >= overlay.matches->size())
+            return;
+        overlay.sel++;
+        break;
+    case XK_Left:
+    case XK_Up:
+        if (!overlay.sel)
+            return;
+        overlay.sel--;
+        break;
+    default:
+        if (n <= 0 || static_cast<unsigned char>(buf[0]) < ' ' ||
+            buf[0] == 0x7f)
+            return;
+        overlay.query.append(buf, n);
+        overlayfilter();
+    }
+    paintoverlay();
+}
+
+void paintoverlay(void)
+{
+    Monitor    *m = overlay.mon;
+    int         x = 0, w, qw;
+    std::size_t i;
+
+    if (!overlay.pix ||
+        overlay.pix->width() != static_cast<unsigned int>(m->mw) ||
+        overlay.pix->height() != static_cast<unsigned int>(bh))
+        overlay.pix = drw->pixmap_create(m->mw, bh);
+    drw->settarget(overlay.pix.get());
+
+    if (overlay.prompt)
+    {
+        drw->setscheme(scheme[SchemeSel]);
+        x = drw->text(0, 0, TEXTW(overlay.prompt), bh, lrpad / 2,
+                      overlay.prompt, 0);
+    }
+    qw = std::min(m->mw / 4, m->mw - x);
+    drw->setscheme(scheme[SchemeNorm]);
+    drw->text(x, 0, qw, bh, lrpad / 2, overlay.query.c_str(), 0);
+    w = TEXTW(overlay.query.c_str()) - lrpad + lrpad / 2;
+    if (w < qw)
+        drw->rect(x + w, 2, 2, bh - 4, 1, 0);
+    x += qw;
+
+    /* scroll so that the selection is visible, keeping it at the end of the
+     * page when moving right */
+    auto width = [](std::size_t i)
+    {
+        return std::min<int>(
+            TEXTW((*overlay.items)[(*overlay.matches)[i]].c_str()),
+            overlay.mon->mw / 3);
+    };
+    if (overlay.sel < overlay.first)
+        overlay.first = overlay.sel;
+    for (w = 0, i = overlay.sel + 1;
+         !overlay.matches->empty() && i-- > overlay.first;)
+        if ((w += width(i)) > m->mw - x)
+        {
+            overlay.first = std::min(i + 1, overlay.sel);
+            break;
+        }
+    for (i = overlay.first; i < overlay.matches->size() && x < m->mw; i++)
+    {
+        w = std::min(width(i), m->mw - x);
+        drw->setscheme(scheme[i == overlay.sel ? SchemeSel : SchemeNorm]);
+        drw->text(x, 0, w, bh, lrpad / 2,
+                  (*overlay.items)[(*overlay.matches)[i]].c_str(), 0);
+        x += w;
+    }
+    if (x < m->mw)
+    {
+        drw->setscheme(scheme[SchemeNorm]);
+        drw->rect(x, 0, m->mw - x, bh, 1, 1);
+    }
+    drw->map(overlay.win, 0, 0, m->mw, bh);
+}
+
+/* moves a new floating client to where it overlaps the least with the other
+ * floating clients of its monitor, as close as possible to where it asked */
+void placeclient(Client *c)
+{
+    static std::vector<zi::rect> taken;
+    Client                      *t;
+    Monitor                     *m = c->mon;
+    zi::rect                     r;
+
+    taken.clear();
+    for (t = m->clients; t; t = t->next)
+        if (t != c && ISVISIBLE(t) &&
+            (t->isfloating || !m->lt[m->sellt]->arrange))
+            taken.push_back({t->x, t->y, t->full_width(), t->full_height()});
+    r    = zi::place({m->wx, m->wy, m->ww, m->wh}, c->full_width(),
+                     c->full_height(), taken, c->x, c->y);
+    c->x = r.x;
+    c->y = r.y;
+}
+
 void pop(Client *c)
 {
     detach(c);
@@ -1379,6 +2725,93 @@ void pop(Client *c)
     arrange(c->mon);
 }
 
+/* Looks up the fallback fonts for the prewarm blocks on a worker thread; the
+ * display dependent defaults are substituted here, since the worker must not
+ * touch Xlib. */
+void prewarmfonts(void)
+{
+    std::vector<long> codepoints(std::begin(prewarm), std::end(prewarm));
+    FcPattern        *base;
+
+    if (codepoints.empty() || !(base = drw->fontset_fallbackbase()))
+        return;
+    fontwarm = std::make_unique<zi::fontwarmer>(base, std::move(codepoints));
+}
+
+/* Moves the input events of the batch ahead of the housekeeping ones, so a
+ * storm of property changes or configure requests does not delay a key
+ * press. Per window the order is kept: input that follows housekeeping for
+ * the same client window stays behind it; status updates on the root window
+ * hold nothing back. Windows being mapped, unmapped or destroyed change what
+ * selmon->sel is, and grabbed keys are reported on the root window whatever
+ * they end up acting on, so no input moves ahead of such an event at all.
+ * Since batches are bounded and handled in full before the next is read,
+ * housekeeping waits at most one batch worth of input. */
+void prioritize(void)
+{
+    static std::vector<XEvent> input, rest;
+    static std::vector<Window> busy;
+    Window                     w;
+    int                        barrier = 0;
+
+    input.clear();
+    rest.clear();
+    busy.clear();
+    for (auto &ev : batch)
+    {
+        w = eventwindow(&ev);
+        if (isinput(ev.type) && !barrier &&
+            std::find(busy.begin(), busy.end(), w) == busy.end())
+            input.push_back(ev);
+        else
+        {
+            rest.push_back(ev);
+            if (!isinput(ev.type) && w != display->root_window() &&
+                std::find(busy.begin(), busy.end(), w) == busy.end())
+                busy.push_back(w);
+            barrier |= ev.type == MapRequest || ev.type == UnmapNotify ||
+                       ev.type == DestroyNotify;
+        }
+    }
+    if (rest.empty() || input.empty())
+        return;
+    batch.assign(input.begin(), input.end());
+    batch.insert(batch.end(), rest.begin(), rest.end());
+}
+
+/* With profiling on, each launch from a binding logs how long it took until
+ * the program was running. */
+void profilelaunch(const char *cmd, long long us, const char *how)
+{
+    std::FILE *f = profilepath ? std::fopen(profilepath, "a") : stderr;
+
+    if (!f)
+        return;
+    std::fprintf(f, "launch %s: %lld.%03lld ms via %s\n", cmd, us / 1000,
+                 us % 1000, how);
+    if (f != stderr)
+        std::fclose(f);
+}
+
+/* Writes the startup profile once, after the first event was handled. */
+void profilereport(void)
+{
+    static int  done = 0;
+    std::FILE  *f;
+
+    if (done)
+        return;
+    done = 1;
+    profiler.mark("first event");
+    if (!profilepath)
+        profiler.report(stderr);
+    else if ((f = std::fopen(profilepath, "a")))
+    {
+        profiler.report(f);
+        std::fclose(f);
+    }
+}
+
 void propertynotify(XEvent *e)
 {
     Client         *c;
@@ -1411,8 +2844,14 @@ void propertynotify(XEvent *e)
         }
         if (ev->atom == XA_WM_NAME || ev->atom == netatom[NetWMName])
         {
-            updatetitle(c);
-            if (c == c->mon->sel)
+            /* clients retitling faster than titlerate are read again
+             * once their interval is over, see runtimers() */
+            if (zi::monotonic_ms() < c->titlenext)
+            {
+                titlespending += !c->titlepending;
+                c->titlepending = 1;
+            }
+            else if (updatetitle(c) && c == c->mon->sel)
                 drawbar(c->mon);
         }
         if (ev->atom == netatom[NetWMWindowType])
@@ -1429,16 +2868,193 @@ void quit(const Arg *arg)
 
 Monitor *recttomon(int x, int y, int w, int h)
 {
-    Monitor *m, *r   = selmon;
-    int      a, area = 0;
+    Monitor *r    = selmon;
+    int      area = 0;
+
+    /* ties go to the lowest numbered monitor, as a list walk would do */
+    monindex.overlapping({x, y, w, h},
+                         [&](Monitor *m)
+                         {
+                             int a = INTERSECT(x, y, w, h, m);
+                             if (a > area ||
+                                 (a && a == area && m->num < r->num))
+                             {
+                                 area = a;
+                                 r    = m;
+                             }
+                         });
+    return r;
+}
 
-    for (m = mons; m; m = m->next)
-        if ((a = INTERSECT(x, y, w, h, m)) > area)
+/* The configuration file on top of the defaults, the defaults alone if there
+ * is no such file, and NULL after reporting the first error if the file
+ * cannot be used. */
+std::unique_ptr<Config> readconfig(void)
+{
+    auto                       cf = defaultconfig();
+    std::string                text, error;
+    std::vector<zi::conf_line> lines;
+    std::vector<Key>           livekeys;
+    std::vector<Button>        livebuttons;
+
+    if (!zi::conf_read(conffile.c_str(), text))
+    {
+        if (errno == ENOENT)
+            return cf;
+        fprintf(stderr, "dwm: %s: %s\n", conffile.c_str(), strerror(errno));
+        return nullptr;
+    }
+    if (!zi::conf_parse(text, lines, error))
+    {
+        fprintf(stderr, "dwm: %s: %s\n", conffile.c_str(), error.c_str());
+        return nullptr;
+    }
+    for (auto &l : lines)
+        if (!confline(cf.get(), l.words, error))
         {
-            area = a;
-            r    = m;
+            fprintf(stderr, "dwm: %s: line %d: %s\n", conffile.c_str(),
+                    l.lineno, error.c_str());
+            return nullptr;
         }
-    return r;
+    if (cf->fonts.empty())
+    {
+        fprintf(stderr, "dwm: %s: no fonts\n", conffile.c_str());
+        return nullptr;
+    }
+    /* leave out what was unbound or bound again */
+    for (auto const &k : cf->keys)
+        if (k.func)
+            livekeys.push_back(k);
+    for (auto const &b : cf->buttons)
+        if (b.func)
+            livebuttons.push_back(b);
+    cf->keys.swap(livekeys);
+    cf->buttons.swap(livebuttons);
+    return cf;
+}
+
+/* Collects the exited children and starts the autostart entries that were
+ * waiting for them. */
+void reapchildren(void)
+{
+    char        buf[64];
+    pid_t       pid;
+    std::size_t i;
+    int         changed = 0;
+
+    while (read(childpipe[0], buf, sizeof buf) > 0)
+        ;
+    while (0 < (pid = waitpid(-1, nullptr, WNOHANG)))
+        for (i = 0; i < autopid.size(); i++)
+            if (autopid[i] == pid)
+            {
+                autopid[i] = 0;
+                if (autostate[i] == AutoRunning)
+                {
+                    autostate[i] = AutoReady;
+                    changed      = 1;
+                }
+            }
+    if (changed)
+        startautostart();
+}
+
+/* Swaps in the configuration file after it was written. Only what depends
+ * on the parts that differ is redone: the fonts and with them the bar
+ * height, the colour schemes and window borders, and the key and button
+ * grabs. Rules apply to the windows managed from now on. A file that cannot
+ * be used leaves everything as it was. */
+void reloadconfig(void)
+{
+    std::unique_ptr<Config> old;
+    int                     newfonts, newcolors, newkeys, newbuttons, i;
+    Client                 *c;
+
+    auto streq = [](const char *a, const char *b) { return !strcmp(a, b); };
+    auto samekeys = [](Key const &a, Key const &b)
+    { return a.mod == b.mod && a.keysym == b.keysym; };
+    auto samebuttons = [](Button const &a, Button const &b)
+    {
+        return a.click == b.click && a.mask == b.mask && a.button == b.button;
+    };
+    auto onclient = [](Button const &b) { return b.click == ClkClientWin; };
+
+    if (!(old = readconfig()))
+        return;
+    conf.swap(old);
+
+    newfonts  = !std::ranges::equal(conf->fonts, old->fonts, streq);
+    newcolors = false;
+    for (i = 0; i < SchemeLast; i++)
+        newcolors |=
+            !std::ranges::equal(conf->colors[i], old->colors[i], streq);
+    newkeys = !std::ranges::equal(conf->keys, old->keys, samekeys);
+    newbuttons =
+        !std::ranges::equal(conf->buttons | std::views::filter(onclient),
+                            old->buttons | std::views::filter(onclient),
+                            samebuttons);
+
+    if (newfonts)
+    {
+        if (!drw->fontset_create(conf->fonts.data(), conf->fonts.size()))
+        {
+            fprintf(stderr, "dwm: %s: no fonts could be loaded\n",
+                    conffile.c_str());
+            conf.swap(old);
+            return;
+        }
+        /* the fallbacks still being looked up belong to the old set */
+        fontwarm.reset();
+        lrpad = drw->fonts->full_height();
+        bh    = drw->fonts->full_height() + 2;
+        prewarmfonts();
+        for (auto &m : mons)
+        {
+            updatebarpos(m.get());
+            XMoveResizeWindow(display->xhandle(), m->barwin, m->wx, m->by,
+                              m->ww, bh);
+        }
+        arrange(nullptr);
+    }
+    if (newcolors)
+    {
+        for (i = 0; i < SchemeLast; i++)
+        {
+            drw->scm_free(scheme[i], 3);
+            scheme[i] = drw->scm_create(conf->colors[i].data(), 3);
+        }
+        for (auto &m : mons)
+            for (c = m->clients; c; c = c->next)
+                XSetWindowBorder(
+                    display->xhandle(), c->win,
+                    scheme[c == selmon->sel ? SchemeSel : SchemeNorm][ColBorder]
+                        .pixel);
+    }
+    if (newfonts || newcolors)
+    {
+        if (overlay.open)
+            closeoverlay();
+        for (auto &m : mons)
+            m->segs.clear();
+        drawbars();
+    }
+    if (newkeys)
+        grabkeys();
+    if (newbuttons)
+        for (auto &m : mons)
+            for (c = m->clients; c; c = c->next)
+                grabbuttons(c, c == selmon->sel);
+}
+
+/* the index covers the whole monitor, a superset of the window area that
+ * recttomon() weighs, so it only needs rebuilding when monitors change */
+void reindexmons(void)
+{
+    std::vector<std::pair<Monitor *, zi::rect>> regions;
+
+    for (auto &m : mons)
+        regions.push_back({m.get(), {m->mx, m->my, m->mw, m->mh}});
+    monindex.build(regions);
 }
 
 void resize(Client *c, int x, int y, int w, int h, int interact)
@@ -1460,6 +3076,7 @@ void resizeclient(Client *c, int x, int y, int w, int h)
     c->oldh         = c->h;
     c->h = wc.height = h;
     wc.border_width  = c->bw;
+    c->mon->indexdirty = 1;
     XConfigureWindow(display->xhandle(), c->win,
                      CWX | CWY | CWWidth | CWHeight | CWBorderWidth, &wc);
     configure(c);
@@ -1478,6 +3095,7 @@ void resizemouse(const Arg *)
         return;
     if (c->isfullscreen) /* no support resizing fullscreen windows by mouse */
         return;
+    unbatch(); /* the drag loop below reads from the X queue */
     restack(selmon);
     ocx = c->x;
     ocy = c->y;
@@ -1533,163 +3151,408 @@ void resizemouse(const Arg *)
     }
 }
 
-void restack(Monitor *m)
+void restack(Monitor *m)
+{
+    Client        *c;
+    XEvent         ev;
+    XWindowChanges wc;
+
+    drawbar(m);
+    if (!m->sel)
+        return;
+    if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
+        XRaiseWindow(display->xhandle(), m->sel->win);
+    if (m->lt[m->sellt]->arrange)
+    {
+        wc.stack_mode = Below;
+        wc.sibling    = m->barwin;
+        for (c = m->stack; c; c = c->snext)
+            if (!c->isfloating && ISVISIBLE(c))
+            {
+                XConfigureWindow(display->xhandle(), c->win,
+                                 CWSibling | CWStackMode, &wc);
+                wc.sibling = c->win;
+            }
+    }
+    display->sync();
+    while (XCheckMaskEvent(display->xhandle(), EnterWindowMask, &ev))
+        ;
+    dropbatched(EnterNotify);
+}
+
+/* Adopts the windows savestate() recorded, of those scan() found, with their
+ * previous monitor, tags, geometry and stacking, and puts the monitors back
+ * as they were; everything is arranged once at the end. */
+void restorestate(std::unordered_map<Window, XWindowAttributes *> const &wins)
+{
+    const char  *env = getenv("DWM_STATE_FD");
+    char         line[1024];
+    FILE        *f;
+    int          fd, num, selnum = -1, nmaster, showbar, lt[2], k, full, off;
+    unsigned int seltags, sellt, tagset[2];
+    float        mfact;
+    Window       selwin;
+    Client       c{}, *t;
+    Monitor     *m;
+
+    std::vector<Client>             saved;
+    std::unordered_map<Window, int> rank; /* position in the focus stack */
+    std::unordered_map<Window, int> sel;  /* monitor a client was sel of */
+    std::vector<Client *>           order;
+
+    if (!env)
+        return;
+    fd = atoi(env);
+    unsetenv("DWM_STATE_FD");
+    /* inherited on purpose, but nothing started from here on needs it */
+    if (fd <= STDERR_FILENO || fcntl(fd, F_SETFD, FD_CLOEXEC) < 0)
+        return;
+    if (lseek(fd, 0, SEEK_SET) < 0 || !(f = fdopen(fd, "r")))
+    {
+        close(fd);
+        return;
+    }
+    if (!fgets(line, sizeof line, f) || strcmp(line, "dwm-state 1\n"))
+    {
+        fclose(f);
+        return;
+    }
+    while (fgets(line, sizeof line, f))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (sscanf(line, "s %d", &num) == 1)
+            selnum = num;
+        else if (sscanf(line, "m %d %f %d %u %u %u %u %d %d %d %lu", &num,
+                        &mfact, &nmaster, &seltags, &sellt, &tagset[0],
+                        &tagset[1], &showbar, &lt[0], &lt[1], &selwin) == 11 &&
+                 num >= 0 && std::cmp_less(num, mons.size()))
+        {
+            m          = mons[num].get();
+            m->mfact   = std::clamp(mfact, 0.05f, 0.95f);
+            m->nmaster = std::max(nmaster, 0);
+            m->seltags = seltags & 1;
+            m->sellt   = sellt & 1;
+            m->showbar = showbar;
+            for (k = 0; k < 2; k++)
+                if (tagset[k] & TAGMASK)
+                    m->tagset[k] = tagset[k] & TAGMASK;
+            for (k = 0; k < 2; k++)
+                if (lt[k] >= 0 && std::cmp_less(lt[k], std::size(layouts)))
+                    m->lt[k] = &layouts[lt[k]];
+            sel[selwin] = num;
+        }
+        else if (sscanf(line,
+                        "c %lu %d %d %u %d %d %d %d %d %d %d %d %d %d %d %d "
+                        "%d %n",
+                        &c.win, &num, &k, &c.tags, &c.isfloating, &full,
+                        &c.oldstate, &c.bw, &c.oldbw, &c.x, &c.y, &c.w, &c.h,
+                        &c.oldx, &c.oldy, &c.oldw, &c.oldh, &off) == 17 &&
+                 num >= 0 && std::cmp_less(num, mons.size()) &&
+                 c.tags & TAGMASK)
+        {
+            c.mon          = mons[num].get();
+            c.tags        &= TAGMASK;
+            c.isfullscreen = full;
+            c.klass        = line + off;
+            rank[c.win]    = k;
+            saved.push_back(c);
+        }
+    }
+    fclose(f);
+
+    /* in reverse, since attach() puts each client first */
+    for (auto it = saved.rbegin(); it != saved.rend(); ++it)
+    {
+        auto w = wins.find(it->win);
+        if (w != wins.end() && !wintoclient(it->win))
+            manage(it->win, w->second, &*it);
+    }
+    for (auto &mp : mons)
+    {
+        order.clear();
+        for (t = mp->clients; t; t = t->next)
+            order.push_back(t);
+        std::sort(order.begin(), order.end(),
+                  [&](Client *a, Client *b)
+                  { return rank[a->win] > rank[b->win]; });
+        mp->stack = nullptr;
+        for (auto o : order)
+            attachstack(o);
+        mp->sel = nullptr;
+        updatebarpos(mp.get());
+        XMoveResizeWindow(display->xhandle(), mp->barwin, mp->wx, mp->by,
+                          mp->ww, bh);
+    }
+    for (auto &[w, n] : sel)
+        if ((t = wintoclient(w)) && t->mon->num == n)
+            t->mon->sel = t;
+    if (selnum >= 0 && std::cmp_less(selnum, mons.size()))
+        selmon = mons[selnum].get();
+    arrange(nullptr);
+    focus(selmon->sel);
+}
+
+void run(void)
+{
+    XEvent        ev;
+    struct pollfd pfd[5];
+    int           n, timeout;
+
+    prewarmfonts();
+    /* the run menu should not be the first to read $PATH */
+    pathindex->refresh();
+    pfd[0] = {ConnectionNumber(display->xhandle()), POLLIN, 0};
+    pfd[1] = {fontwarm ? fontwarm->fd() : -1, POLLIN, 0};
+    pfd[2] = {childpipe[0], POLLIN, 0};
+    pfd[3] = {confwatch ? confwatch->fd() : -1, POLLIN, 0};
+    pfd[4] = {pathindex->fd(), POLLIN, 0};
+
+    /* main event loop */
+    display->sync();
+    while (running)
+    {
+        /* read everything that is queued at once, so that handlers can look
+         * ahead and fold work for the same window */
+        batch.clear();
+        for (n = std::min<int>(XPending(display->xhandle()), batchmax); n > 0;
+             n--)
+        {
+            XNextEvent(display->xhandle(), &ev);
+            batch.push_back(ev);
+        }
+        prioritize();
+        for (batchpos = 0; running && batchpos < batch.size(); batchpos++)
+            dispatch(&batch[batchpos]);
+        if (profiler.enabled() && !batch.empty())
+            profilereport(); /* startup ends with the first event */
+        batch.clear();
+        if (!running)
+            break;
+        if (geomdirty && !XPending(display->xhandle()))
+            applygeom();
+        /* wait for the next event or the next deadline, whichever is first;
+         * the other descriptors are looked at even while events keep coming */
+        timeout = runtimers();
+        XFlush(display->xhandle());
+        if (XPending(display->xhandle()))
+            timeout = 0;
+        if (poll(pfd, std::size(pfd), timeout) > 0)
+        {
+            if (pfd[1].revents & POLLIN)
+                for (auto &[cp, match] : fontwarm->take())
+                    drw->fontset_add(cp, match);
+            if (pfd[2].revents & POLLIN)
+                reapchildren();
+            /* between batches, so no handler holds on to the old tables */
+            if ((pfd[3].revents & POLLIN) && confwatch->changed())
+            {
+                reloadconfig();
+                pfd[1].fd = fontwarm ? fontwarm->fd() : -1;
+            }
+            if ((pfd[4].revents & POLLIN) && pathindex->refresh() &&
+                overlay.items == &pathindex->names())
+                overlayitems();
+        }
+    }
+}
+
+/* Runs the deferred work that is due and returns the number of milliseconds
+ * until the next deadline, or -1 if nothing is scheduled. */
+int runtimers(void)
 {
-    Client        *c;
-    XEvent         ev;
-    XWindowChanges wc;
+    long long now = zi::monotonic_ms(), next = -1;
+    Client   *c;
 
-    drawbar(m);
-    if (!m->sel)
-        return;
-    if (m->sel->isfloating || !m->lt[m->sellt]->arrange)
-        XRaiseWindow(display->xhandle(), m->sel->win);
-    if (m->lt[m->sellt]->arrange)
+    if (dwelling && dwellat <= now)
     {
-        wc.stack_mode = Below;
-        wc.sibling    = m->barwin;
-        for (c = m->stack; c; c = c->snext)
-            if (!c->isfloating && ISVISIBLE(c))
+        dwelling = 0;
+        entermon(dwellclient, dwellclient ? dwellclient->mon : dwellmon);
+    }
+    else if (dwelling)
+        next = dwellat;
+    if (titlespending)
+        for (auto &m : mons)
+            for (c = m->clients; c; c = c->next)
             {
-                XConfigureWindow(display->xhandle(), c->win,
-                                 CWSibling | CWStackMode, &wc);
-                wc.sibling = c->win;
+                if (!c->titlepending)
+                    continue;
+                if (c->titlenext <= now)
+                {
+                    c->titlepending = 0;
+                    titlespending--;
+                    if (updatetitle(c) && c == c->mon->sel)
+                        drawbar(c->mon);
+                }
+                else if (next < 0 || c->titlenext < next)
+                    next = c->titlenext;
             }
+    for (auto &m : mons)
+    {
+        if (!m->barpending)
+            continue;
+        if (m->barnext <= now)
+            drawbar(m.get());
+        else if (next < 0 || m->barnext < next)
+            next = m->barnext;
     }
-    display->sync();
-    while (XCheckMaskEvent(display->xhandle(), EnterWindowMask, &ev))
-        ;
+    return next < 0 ? -1 : static_cast<int>(next - now);
 }
 
-void run(void)
+#ifdef XRANDR
+void rrnotify(XEvent *e)
 {
-    XEvent ev;
-    /* main event loop */
-    display->sync();
-    while (running && !XNextEvent(display->xhandle(), &ev))
-        if (handler[ev.type])
-            handler[ev.type](&ev); /* call handler */
+    XRRUpdateConfiguration(e);
+    geomdirty = 1;
 }
+#endif /* XRANDR */
 
+/* Starts the autostart entries that do not wait for anything; the rest are
+ * started by reapchildren() as the entries before them become ready. */
 void runautostart(void)
 {
-    char       *pathpfx;
-    char       *path;
-    char       *xdgdatahome;
-    char       *home;
-    struct stat sb;
-
-    if ((home = getenv("HOME")) == nullptr)
-        /* this is almost impossible */
-        return;
+    std::size_t i;
+    const char *p, *q;
+
+    autostate.assign(std::size(autostart), AutoWaiting);
+    autopid.assign(std::size(autostart), 0);
+    for (i = 0; i < std::size(autostart); i++)
+        for (p = autostart[i].after; autostartnext(&p, &q); p = q)
+            if (autostartfind(p, q) == std::size(autostart))
+                fprintf(stderr, "dwm: autostart %s: no entry %.*s\n",
+                        autostart[i].name, static_cast<int>(q - p), p);
+    startautostart();
+}
 
-    /* if $XDG_DATA_HOME is set and not empty, use $XDG_DATA_HOME/dwm,
-     * otherwise use ~/.local/share/dwm as autostart script directory
-     */
-    xdgdatahome = getenv("XDG_DATA_HOME");
-    if (xdgdatahome != nullptr && *xdgdatahome != '\0')
-    {
-        /* space for path segments, separators and nul */
-        pathpfx =
-            zi::safe_calloc<char>(strlen(xdgdatahome) + strlen(dwmdir) + 2);
+/* Writes every monitor and client to an unlinked file that survives the
+ * exec of a restart and is handed over in $DWM_STATE_FD, see restorestate().
+ * One line per monitor and per client, in the order of the client lists. */
+void savestate(void)
+{
+    char     num[16];
+    int      fd, rank;
+    FILE    *f;
+    Client  *c, *t;
+    Monitor *m;
 
-        if (sprintf(pathpfx, "%s/%s", xdgdatahome, dwmdir) <= 0)
-        {
-            free(pathpfx);
-            return;
-        }
-    }
-    else
+#ifdef __linux__
+    fd = memfd_create("dwm-state", 0);
+#else
+    char path[] = "/tmp/dwm-state.XXXXXX";
+    if ((fd = mkstemp(path)) >= 0)
+        unlink(path);
+#endif
+    if (fd < 0)
+        return;
+    if (!(f = fdopen(dup(fd), "w")))
     {
-        /* space for path segments, separators and nul */
-        pathpfx = zi::safe_calloc<char>(strlen(home) + strlen(localshare) +
-                                        strlen(dwmdir) + 3);
-
-        if (sprintf(pathpfx, "%s/%s/%s", home, localshare, dwmdir) < 0)
-        {
-            free(pathpfx);
-            return;
-        }
+        close(fd);
+        return;
     }
-
-    /* check if the autostart script directory exists */
-    if (!(stat(pathpfx, &sb) == 0 && S_ISDIR(sb.st_mode)))
+    fprintf(f, "dwm-state 1\ns %d\n", selmon->num);
+    for (auto &mp : mons)
     {
-        /* the XDG conformant path does not exist or is no directory
-         * so we try ~/.dwm instead
-         */
-        char *pathpfx_new = reinterpret_cast<char *>(
-            realloc(pathpfx, strlen(home) + strlen(dwmdir) + 3));
-        if (pathpfx_new == nullptr)
-        {
-            free(pathpfx);
-            return;
-        }
-        pathpfx = pathpfx_new;
-
-        if (sprintf(pathpfx, "%s/.%s", home, dwmdir) <= 0)
+        m = mp.get();
+        fprintf(f, "m %d %.9g %d %u %u %u %u %d %d %d %lu\n", m->num,
+                m->mfact, m->nmaster, m->seltags, m->sellt, m->tagset[0],
+                m->tagset[1], m->showbar,
+                static_cast<int>(m->lt[0] - layouts),
+                static_cast<int>(m->lt[1] - layouts),
+                m->sel ? m->sel->win : None);
+        for (c = m->clients; c; c = c->next)
         {
-            free(pathpfx);
-            return;
+            for (rank = 0, t = m->stack; t && t != c; t = t->snext)
+                rank++;
+            fprintf(f,
+                    "c %lu %d %d %u %d %d %d %d %d %d %d %d %d %d %d %d %d "
+                    "%s\n",
+                    c->win, m->num, rank, c->tags, c->isfloating,
+                    c->isfullscreen, c->oldstate, c->bw, c->oldbw, c->x,
+                    c->y, c->w, c->h, c->oldx, c->oldy, c->oldw, c->oldh,
+                    c->klass.c_str());
         }
     }
-
-    /* try the blocking script first */
-    path =
-        zi::safe_calloc<char>(strlen(pathpfx) + strlen(autostartblocksh) + 2);
-    if (sprintf(path, "%s/%s", pathpfx, autostartblocksh) <= 0)
+    if (fclose(f))
     {
-        free(path);
-        free(pathpfx);
+        close(fd);
+        return;
     }
+    snprintf(num, sizeof num, "%d", fd);
+    setenv("DWM_STATE_FD", num, 1);
+}
 
-    if (access(path, X_OK) == 0)
-        system(path);
-
-    /* now the non-blocking script */
-    if (sprintf(path, "%s/%s", pathpfx, autostartsh) <= 0)
+/* Adopts the windows that already exist. All the queries for all children
+ * are sent before the first reply is waited for, so startup costs one round
+ * trip for the tree and one for everything else rather than several per
+ * window. */
+void scan(void)
+{
+    struct child
     {
-        free(path);
-        free(pathpfx);
-    }
+        Window            win;
+        XWindowAttributes wa;
+        int               transient, iconic;
+    };
 
-    if (access(path, X_OK) == 0)
-        system(strcat(path, " &"));
+    std::size_t        i, n;
+    int                pass;
+    xcb_window_t      *wins;
+    std::vector<child> children;
 
-    free(pathpfx);
-    free(path);
-}
+    std::unordered_map<Window, XWindowAttributes *> found;
 
-void scan(void)
-{
-    unsigned int      i, num;
-    Window            d1, d2, *wins = nullptr;
-    XWindowAttributes wa;
+    auto tree = display->query_tree(display->root_window()).get();
+    if (!tree)
+        return;
+    wins = xcb_query_tree_children(tree.get());
+    n    = xcb_query_tree_children_length(tree.get());
 
-    if (XQueryTree(display->xhandle(), display->root_window(), &d1, &d2, &wins,
-                   &num))
+    std::vector<zi::display::window_attributes_future> attrs(n);
+    std::vector<zi::display::geometry_future>          geoms(n);
+    std::vector<zi::display::property_future>          trans(n), states(n);
+    for (i = 0; i < n; i++)
     {
-        for (i = 0; i < num; i++)
-        {
-            if (!XGetWindowAttributes(display->xhandle(), wins[i], &wa) ||
-                wa.override_redirect ||
-                XGetTransientForHint(display->xhandle(), wins[i], &d1))
-                continue;
-            if (wa.map_state == IsViewable || getstate(wins[i]) == IconicState)
-                manage(wins[i], &wa);
-        }
-        for (i = 0; i < num; i++)
-        { /* now the transients */
-            if (!XGetWindowAttributes(display->xhandle(), wins[i], &wa))
-                continue;
-            if (XGetTransientForHint(display->xhandle(), wins[i], &d1) &&
-                (wa.map_state == IsViewable ||
-                 getstate(wins[i]) == IconicState))
-                manage(wins[i], &wa);
-        }
-        if (wins)
-            XFree(wins);
+        attrs[i]  = display->get_window_attributes(wins[i]);
+        geoms[i]  = display->get_geometry(wins[i]);
+        trans[i]  = display->get_property(wins[i], XA_WM_TRANSIENT_FOR,
+                                          XA_WINDOW, 1);
+        states[i] = display->get_property(wins[i], wmatom[WMState],
+                                          wmatom[WMState], 2);
+    }
+    for (i = 0; i < n; i++)
+    {
+        auto a = attrs[i].get();
+        auto g = geoms[i].get();
+        auto t = trans[i].get();
+        auto s = states[i].get();
+        child c{};
+
+        if (!a || !g || a->override_redirect)
+            continue;
+        c.win             = wins[i];
+        c.wa.x            = g->x;
+        c.wa.y            = g->y;
+        c.wa.width        = g->width;
+        c.wa.height       = g->height;
+        c.wa.border_width = g->border_width;
+        c.wa.map_state    = a->map_state;
+        c.transient = t && t->type == XA_WINDOW && t->format == 32 &&
+                      xcb_get_property_value_length(t.get()) >= 4;
+        c.iconic    = s && s->format == 32 &&
+                   xcb_get_property_value_length(s.get()) >= 4 &&
+                   *static_cast<std::uint32_t *>(
+                       xcb_get_property_value(s.get())) == IconicState;
+        if (c.wa.map_state == IsViewable || c.iconic)
+            children.push_back(c);
     }
+    /* after a restart, what the previous dwm managed comes back first */
+    for (auto &c : children)
+        found[c.win] = &c.wa;
+    restorestate(found);
+    /* transients last, so that what they are transient for is managed */
+    for (pass = 0; pass < 2; pass++)
+        for (auto &c : children)
+            if (c.transient == pass && !wintoclient(c.win))
+                manage(c.win, &c.wa);
 }
 
 void sendmon(Client *c, Monitor *m)
@@ -1808,7 +3671,8 @@ void setmfact(const Arg *arg)
     if (!arg || !selmon->lt[selmon->sellt]->arrange)
         return;
     f = arg->f < 1.0 ? arg->f + selmon->mfact : arg->f - 1.0;
-    if (f < 0.05 || f > 0.95)
+    f = std::clamp(f, 0.05f, 0.95f);
+    if (f == selmon->mfact)
         return;
     selmon->mfact = f;
     arrange(selmon);
@@ -1819,11 +3683,36 @@ void setup(void)
     // setup the error handler
     xerrorxlib = XSetErrorHandler(xerror);
     display->sync();
+    /* errors of async requests take the same way as those of Xlib */
+    display->on_error(
+        [](xcb_generic_error_t const &e)
+        {
+            XErrorEvent ee{};
+
+            ee.display      = display->xhandle();
+            ee.resourceid   = e.resource_id;
+            ee.serial       = e.full_sequence;
+            ee.error_code   = e.error_code;
+            ee.request_code = e.major_code;
+            ee.minor_code   = e.minor_code;
+            xerror(display->xhandle(), &ee);
+        });
 
     int                  i;
+    std::size_t          phase;
+    const char          *p;
     XSetWindowAttributes wa;
-    Atom                 utf8string;
 
+    pathindex = std::make_unique<zi::path_index>(getenv("PATH"));
+    /* children are reaped from the event loop, see sigchld */
+    if (pipe(childpipe) == 0)
+        for (int fd : childpipe)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    /* nothing started by dwm needs the X connection */
+    fcntl(ConnectionNumber(display->xhandle()), F_SETFD, FD_CLOEXEC);
     /* clean up any zombies immediately */
     sigchld(0);
 
@@ -1836,57 +3725,75 @@ void setup(void)
     // root = display->root_window(); // RootWindow(display->xhandle(),
     // display->screen());
     drw = std::make_unique<zi::drawable>(display->xhandle(), display->screen(),
-                                         display->root_window(), sw, sh);
-
-    if (!drw->fontset_create(fonts, std::size(fonts)))
+                                         display->root_window());
+
+    phase = profiler.begin("config");
+    if ((p = getenv("XDG_CONFIG_HOME")) && *p)
+        conffile = std::string(p) + "/dwm/dwmrc";
+    else if ((p = getenv("HOME")))
+        conffile = std::string(p) + "/.config/dwm/dwmrc";
+    if (!(conf = readconfig()))
+        conf = defaultconfig();
+    confwatch = std::make_unique<zi::conf_watch>(conffile);
+    profiler.end(phase);
+
+    phase = profiler.begin("fonts");
+    if (!drw->fontset_create(conf->fonts.data(), conf->fonts.size()))
     {
-        die("no fonts could be loaded.");
+        /* as with any other error in the file, fall back to config.hpp */
+        fprintf(stderr, "dwm: %s: no fonts could be loaded\n",
+                conffile.c_str());
+        conf = defaultconfig();
+        if (!drw->fontset_create(conf->fonts.data(), conf->fonts.size()))
+            die("no fonts could be loaded.");
     }
+    profiler.end(phase);
 
     lrpad = drw->fonts->full_height();
     bh    = drw->fonts->full_height() + 2;
 
+#ifdef XRANDR
+    {
+        int                 rrerrbase, major = 0, minor = 0;
+        zi::profiler::scope s(profiler, "randr query");
+
+        if (XRRQueryExtension(display->xhandle(), &rrevbase, &rrerrbase) &&
+            XRRQueryVersion(display->xhandle(), &major, &minor) &&
+            (major > 1 || (major == 1 && minor >= 5)))
+            XRRSelectInput(display->xhandle(), display->root_window(),
+                           RRScreenChangeNotifyMask | RRCrtcChangeNotifyMask |
+                               RROutputChangeNotifyMask);
+        else
+            rrevbase = -1;
+    }
+#endif /* XRANDR */
+    phase = profiler.begin("monitors");
     updategeom();
+    profiler.end(phase);
 
     /* init atoms */
-    utf8string = XInternAtom(display->xhandle(), "UTF8_STRING", false);
-    wmatom[WMProtocols] =
-        XInternAtom(display->xhandle(), "WM_PROTOCOLS", false);
-    wmatom[WMDelete] =
-        XInternAtom(display->xhandle(), "WM_DELETE_WINDOW", false);
-    wmatom[WMState] = XInternAtom(display->xhandle(), "WM_STATE", false);
-    wmatom[WMTakeFocus] =
-        XInternAtom(display->xhandle(), "WM_TAKE_FOCUS", false);
-    netatom[NetActiveWindow] =
-        XInternAtom(display->xhandle(), "_NET_ACTIVE_WINDOW", false);
-    netatom[NetSupported] =
-        XInternAtom(display->xhandle(), "_NET_SUPPORTED", false);
-    netatom[NetWMName] = XInternAtom(display->xhandle(), "_NET_WM_NAME", false);
-    netatom[NetWMState] =
-        XInternAtom(display->xhandle(), "_NET_WM_STATE", false);
-    netatom[NetWMCheck] =
-        XInternAtom(display->xhandle(), "_NET_SUPPORTING_WM_CHECK", false);
-    netatom[NetWMFullscreen] =
-        XInternAtom(display->xhandle(), "_NET_WM_STATE_FULLSCREEN", false);
-    netatom[NetWMWindowType] =
-        XInternAtom(display->xhandle(), "_NET_WM_WINDOW_TYPE", false);
-    netatom[NetWMWindowTypeDialog] =
-        XInternAtom(display->xhandle(), "_NET_WM_WINDOW_TYPE_DIALOG", false);
-    netatom[NetClientList] =
-        XInternAtom(display->xhandle(), "_NET_CLIENT_LIST", false);
+    phase = profiler.begin("atoms");
+    internatoms();
+    profiler.end(phase);
     /* init cursors */
+    phase              = profiler.begin("cursors");
     cursors[CurNormal] = drw->cur_create(XC_left_ptr);
     cursors[CurResize] = drw->cur_create(XC_sizing);
     cursors[CurMove]   = drw->cur_create(XC_fleur);
+    profiler.end(phase);
     /* init appearance */
-    scheme = std::make_unique<std::unique_ptr<Clr[]>[]>(std::size(colors));
+    phase  = profiler.begin("colours");
+    scheme = std::make_unique<std::unique_ptr<Clr[]>[]>(SchemeLast);
 
-    for (i = 0; std::cmp_less(i, std::size(colors)); i++)
+    for (i = 0; i < SchemeLast; i++)
     {
-        scheme[i] = drw->scm_create(colors[i], 3);
+        scheme[i] = drw->scm_create(conf->colors[i].data(), 3);
     }
+    profiler.end(phase);
     /* init bars */
+    phase = profiler.begin("bars");
     updatebars();
+    profiler.end(phase);
 
     updatestatus();
     /* supporting window for NetWMCheck */
@@ -1954,10 +3861,17 @@ void showhide(Client *c)
 
 void sigchld(int /* unused */)
 {
+    int saved = errno;
+
     if (signal(SIGCHLD, sigchld) == SIG_ERR)
         die("can't install SIGCHLD handler:");
-    while (0 < waitpid(-1, nullptr, WNOHANG))
-        ;
+    /* run() reaps, since autostart needs to know which child exited */
+    if (childpipe[1] >= 0)
+        (void)!write(childpipe[1], "", 1);
+    else
+        while (0 < waitpid(-1, nullptr, WNOHANG))
+            ;
+    errno = saved;
 }
 
 void sighup(int /* unused */)
@@ -1974,18 +3888,216 @@ void sigterm(int /* unused */)
 
 void spawn(const Arg *arg)
 {
+    const char *const *argv  = static_cast<const char *const *>(arg->v);
+    long long          start = zi::monotonic_us();
+    const char        *path;
+    int                err   = -1;
+
     if (arg->v == dmenucmd)
         dmenumon[0] = '0' + selmon->num;
-    if (fork() == 0)
+    if (!(path = pathindex->lookup(argv[0])))
+    {
+        fprintf(stderr, "dwm: cannot start %s: not in PATH\n", argv[0]);
+        return;
+    }
+    /* the helper reports its own failures, it only has to be alive */
+    if (launcher.running())
+        err = launcher.spawn(path, argv, profiler.enabled());
+    if (err < 0)
+        spawnpath(path, argv);
+    if (profiler.enabled())
+        profilelaunch(argv[0], zi::monotonic_us() - start,
+                      err < 0 ? "posix_spawn" : "helper");
+}
+
+/* Starts argv[0] from $PATH in its own session without blocking; returns the
+ * pid, or -1 after telling why not. */
+pid_t spawnargv(const char *const argv[])
+{
+    const char *path;
+
+    if (!(path = pathindex->lookup(argv[0])))
+    {
+        fprintf(stderr, "dwm: cannot start %s: not in PATH\n", argv[0]);
+        return -1;
+    }
+    return spawnpath(path, argv);
+}
+
+/* Like spawnargv() for a program already looked up as path. */
+pid_t spawnpath(const char *path, const char *const argv[])
+{
+    posix_spawnattr_t attr;
+    pid_t             pid;
+    int               err;
+
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+#endif
+    err = posix_spawn(&pid, path, nullptr, &attr,
+                      const_cast<char *const *>(argv), environ);
+    posix_spawnattr_destroy(&attr);
+    if (err)
+    {
+        fprintf(stderr, "dwm: cannot start %s: %s\n", argv[0], strerror(err));
+        return -1;
+    }
+    return pid;
+}
+
+/* whether everything autostart entry i waits for is ready */
+static bool autostartready(std::size_t i)
+{
+    std::size_t j;
+    const char *p, *q;
+
+    for (p = autostart[i].after; autostartnext(&p, &q); p = q)
+        if ((j = autostartfind(p, q)) < std::size(autostart) &&
+            autostate[j] != AutoReady)
+            return false;
+    return true;
+}
+
+/* Starts every waiting autostart entry whose dependencies are ready, until
+ * that no longer makes further entries ready. */
+void startautostart(void)
+{
+    static std::string dir = autostartdir();
+    std::size_t        i;
+    std::string        script;
+    int                progress, pending;
+
+    do
+    {
+        progress = pending = 0;
+        for (i = 0; i < autostate.size(); i++)
+        {
+            pending |= autostate[i] == AutoRunning;
+            if (autostate[i] != AutoWaiting || !autostartready(i))
+                continue;
+            progress = 1;
+            if (autostart[i].cmd)
+            {
+                autopid[i] = spawnargv(autostart[i].cmd);
+            }
+            else
+            {
+                /* the scripts are optional */
+                script               = dir + "/" + autostart[i].name;
+                const char *argv[2] = {script.c_str(), nullptr};
+                autopid[i] = dir.empty() || access(argv[0], X_OK)
+                                 ? -1
+                                 : spawnargv(argv);
+            }
+            autostate[i] = autopid[i] > 0 && autostart[i].ready == ReadyExit
+                               ? AutoRunning
+                               : AutoReady;
+        }
+    } while (progress);
+
+    /* nothing left that could make the waiting entries ready */
+    if (!pending)
+        for (i = 0; i < autostate.size(); i++)
+            if (autostate[i] == AutoWaiting)
+            {
+                fprintf(stderr, "dwm: autostart %s: dependency cycle\n",
+                        autostart[i].name);
+                autostate[i] = AutoReady;
+            }
+}
+
+/* exchanges the positions of two clients of the same monitor in the client
+ * list, also when they are adjacent */
+void swapclients(Client *a, Client *b)
+{
+    Client **pa, **pb;
+
+    for (pa = &a->mon->clients; *pa && *pa != a; pa = &(*pa)->next)
+        ;
+    for (pb = &b->mon->clients; *pb && *pb != b; pb = &(*pb)->next)
+        ;
+    if (!*pa || !*pb)
+        return;
+    std::swap(*pa, *pb);
+    std::swap(a->next, b->next);
+    a->mon->indexdirty = 1;
+}
+
+void switchaccept(int item, std::string const &)
+{
+    Client *c;
+    Arg     a;
+
+    if (item < 0 || !(c = wintoclient(switchwins[item])))
+        return;
+    if (c->mon != selmon)
+    {
+        unfocus(selmon->sel, 0);
+        selmon = c->mon;
+    }
+    if (!ISVISIBLE(c))
     {
-        if (display->xhandle())
-            close(ConnectionNumber(display->xhandle()));
-        setsid();
-        execvp(((char **)arg->v)[0], (char **)arg->v);
-        fprintf(stderr, "dwm: execvp %s", ((char **)arg->v)[0]);
-        perror(" failed");
-        exit(EXIT_SUCCESS);
+        a.ui = c->tags;
+        view(&a);
     }
+    focus(c);
+    restack(selmon);
+}
+
+/* Lists every client, the most recently focused first, starting with the
+ * selected monitor. */
+void switchmenu(const Arg *)
+{
+    Client     *c;
+    std::size_t i;
+
+    switchwins.clear();
+    switchitems.clear();
+    switchpos.clear();
+    for (i = 0; i < mons.size(); i++)
+        for (c = mons[(selmon->num + i) % mons.size()]->stack; c;
+             c = c->snext)
+        {
+            switchpos[c->win] = switchwins.size();
+            switchwins.push_back(c->win);
+            switchitems.push_back(
+                std::string(tags[std::countr_zero(c->tags)]) + ": " + c->name);
+        }
+    openoverlay("window", switchitems, switchaccept, switchsearch);
+}
+
+/* Clients whose title or class contains every word of query, ranked by how
+ * well the words match and then by focus order. */
+void switchsearch(std::string const &query, std::vector<std::uint32_t> &out)
+{
+    static std::vector<int> scores;
+
+    std::size_t i, j;
+
+    out.clear();
+    scores.assign(switchwins.size(), 0);
+    winindex.query(
+        query,
+        [&](Window w, std::string_view text)
+        {
+            auto it = switchpos.find(w);
+            if (it == switchpos.end())
+                return;
+            out.push_back(it->second);
+            for (i = 0; i < query.size(); i = j)
+            {
+                if ((i = query.find_first_not_of(' ', i)) == std::string::npos)
+                    break;
+                j = std::min(query.find(' ', i), query.size());
+                scores[it->second] += zi::fuzzy_filter::score(
+                    std::string_view(query).substr(i, j - i), text);
+            }
+        });
+    std::sort(out.begin(), out.end(),
+              [](std::uint32_t a, std::uint32_t b) {
+                  return scores[a] != scores[b] ? scores[a] > scores[b] : a < b;
+              });
 }
 
 void tag(const Arg *arg)
@@ -2000,7 +4112,7 @@ void tag(const Arg *arg)
 
 void tagmon(const Arg *arg)
 {
-    if (!selmon->sel || !mons->next)
+    if (!selmon->sel || mons.size() < 2)
         return;
     sendmon(selmon->sel, dirtomon(arg->i));
 }
@@ -2094,6 +4206,18 @@ void toggleview(const Arg *arg)
     }
 }
 
+/* Hands the events of the current batch that were not handled yet back to
+ * the X queue, for handlers that run their own event loop. */
+void unbatch(void)
+{
+    std::size_t i;
+
+    for (i = batch.size(); i > batchpos + 1; i--)
+        if (batch[i - 1].type)
+            XPutBackEvent(display->xhandle(), &batch[i - 1]);
+    batch.resize(std::min(batch.size(), batchpos + 1));
+}
+
 void unfocus(Client *c, int setfocus)
 {
     if (!c)
@@ -2115,22 +4239,25 @@ void unmanage(Client *c, int destroyed)
     Monitor       *m = c->mon;
     XWindowChanges wc;
 
+    if (dwellclient == c)
+        dwelling = 0;
     detach(c);
     detachstack(c);
     if (!destroyed)
     {
+        /* the window may be destroyed under our feet, the errors that
+         * causes are dropped by serial instead of grabbing the server */
+        zi::display::ignore_errors guard(*display);
         wc.border_width = c->oldbw;
-        XGrabServer(display->xhandle()); /* avoid race conditions */
-        XSetErrorHandler(xerrordummy);
         XConfigureWindow(display->xhandle(), c->win, CWBorderWidth,
                          &wc); /* restore border */
         XUngrabButton(display->xhandle(), AnyButton, AnyModifier, c->win);
         setclientstate(c, WithdrawnState);
-        display->sync();
-        XSetErrorHandler(xerror);
-        XUngrabServer(display->xhandle());
     }
-    free(c);
+    if (c->titlepending)
+        titlespending--;
+    winindex.erase(c->win);
+    delete c;
     focus(nullptr);
     updateclientlist();
     arrange(m);
@@ -2152,7 +4279,6 @@ void unmapnotify(XEvent *e)
 
 void updatebars(void)
 {
-    Monitor             *m;
     XSetWindowAttributes wa = {.background_pixmap = ParentRelative,
                                .event_mask = ButtonPressMask | ExposureMask,
                                .override_redirect = true
@@ -2162,7 +4288,7 @@ void updatebars(void)
     static std::string dwm_string = "dwm";
 
     XClassHint ch = {dwm_string.data(), dwm_string.data()};
-    for (m = mons; m; m = m->next)
+    for (auto &m : mons)
     {
         if (m->barwin)
             continue;
@@ -2192,24 +4318,199 @@ void updatebarpos(Monitor *m)
         m->by = -bh;
 }
 
+/* Reads WM_CLASS into c->klass, and class and instance apart into the
+ * strings that are given. */
+void updateclass(Client *c, std::string *klass, std::string *instance)
+{
+    XClassHint  ch = {nullptr, nullptr};
+    const char *k, *i;
+
+    XGetClassHint(display->xhandle(), c->win, &ch);
+    k        = ch.res_class ? ch.res_class : broken;
+    i        = ch.res_name ? ch.res_name : broken;
+    c->klass = std::string(k) + " " + i;
+    if (klass)
+        *klass = k;
+    if (instance)
+        *instance = i;
+    if (ch.res_class)
+        XFree(ch.res_class);
+    if (ch.res_name)
+        XFree(ch.res_name);
+}
+
 void updateclientlist()
 {
-    Client  *c;
-    Monitor *m;
+    Client *c;
 
     XDeleteProperty(display->xhandle(), display->root_window(),
                     netatom[NetClientList]);
-    for (m = mons; m; m = m->next)
+    for (auto &m : mons)
         for (c = m->clients; c; c = c->next)
             XChangeProperty(display->xhandle(), display->root_window(),
                             netatom[NetClientList], XA_WINDOW, 32,
                             PropModeAppend, (unsigned char *)&(c->win), 1);
 }
 
+#ifdef XRANDR
+static float outputrate(XRRScreenResources *res, RROutput output)
+{
+    int            i;
+    float          rate = 0;
+    XRROutputInfo *oi;
+    XRRCrtcInfo   *ci;
+
+    if (!res || !(oi = XRRGetOutputInfo(display->xhandle(), res, output)))
+        return 0;
+    if (oi->crtc && (ci = XRRGetCrtcInfo(display->xhandle(), res, oi->crtc)))
+    {
+        for (i = 0; i < res->nmode; i++)
+        {
+            XRRModeInfo *mi = &res->modes[i];
+            double       v  = mi->vTotal;
+
+            if (mi->id != ci->mode || !mi->hTotal || !mi->vTotal)
+                continue;
+            if (mi->modeFlags & RR_DoubleScan)
+                v *= 2;
+            if (mi->modeFlags & RR_Interlace)
+                v /= 2;
+            rate = mi->dotClock / (mi->hTotal * v);
+        }
+        XRRFreeCrtcInfo(ci);
+    }
+    XRRFreeOutputInfo(oi);
+    return rate;
+}
+
+/* Diffs the RandR monitors against the monitor table by name: monitors that
+ * are still there keep their clients and are only flagged when their
+ * geometry moved, vanished ones hand their slot to new outputs before their
+ * clients are migrated to the first monitor. */
+int updaterandr(void)
+{
+    struct wanted
+    {
+        Atom     name;
+        zi::rect r;
+        float    dpi, refresh;
+        Monitor *m;
+    };
+
+    int                  i, j, n, dirty = 0;
+    Client              *c;
+    Monitor             *m, *to;
+    XRRMonitorInfo      *info;
+    XRRScreenResources  *res;
+    std::vector<wanted>  want;
+    std::vector<Monitor *> gone;
+
+    info = XRRGetMonitors(display->xhandle(), display->root_window(), true, &n);
+    res  = XRRGetScreenResourcesCurrent(display->xhandle(),
+                                        display->root_window());
+    for (i = 0; i < n; i++)
+    {
+        /* only consider unique geometries as separate screens */
+        for (j = 0; j < i; j++)
+            if (info[j].x == info[i].x && info[j].y == info[i].y &&
+                info[j].width == info[i].width &&
+                info[j].height == info[i].height)
+                break;
+        if (j < i)
+            continue;
+        want.push_back({info[i].name,
+                        {info[i].x, info[i].y, info[i].width, info[i].height},
+                        info[i].mwidth ? info[i].width * 25.4f / info[i].mwidth
+                                       : 0,
+                        info[i].noutput ? outputrate(res, info[i].outputs[0])
+                                        : 0,
+                        nullptr});
+    }
+    if (info)
+        XRRFreeMonitors(info);
+    if (res)
+        XRRFreeScreenResources(res);
+    if (want.empty())
+        want.push_back({None, {0, 0, sw, sh}, 0, 0, nullptr});
+
+    /* keep monitors by name, then hand unmatched ones to new outputs */
+    for (auto &w : want)
+        for (auto &mp : mons)
+            if (mp->rrname == w.name && std::none_of(want.begin(), want.end(),
+                                                     [&](wanted const &o)
+                                                     { return o.m == mp.get(); }))
+            {
+                w.m = mp.get();
+                break;
+            }
+    for (auto &mp : mons)
+        if (std::none_of(want.begin(), want.end(),
+                         [&](wanted const &o) { return o.m == mp.get(); }))
+        {
+            auto w = std::find_if(want.begin(), want.end(),
+                                  [](wanted const &o) { return !o.m; });
+            if (w != want.end())
+                w->m = mp.get();
+            else
+                gone.push_back(mp.get());
+        }
+    for (auto &w : want)
+    {
+        if (!w.m)
+        {
+            mons.push_back(createmon());
+            w.m      = mons.back().get();
+            w.m->num = mons.size() - 1;
+            w.m->mw  = -1;
+        }
+        m          = w.m;
+        m->rrname  = w.name;
+        m->refresh = w.refresh;
+        if (w.dpi > 0)
+            m->dpi = w.dpi;
+        if (w.r.x != m->mx || w.r.y != m->my || w.r.w != m->mw ||
+            w.r.h != m->mh)
+        {
+            dirty          = 1;
+            m->geomchanged = 1;
+            m->mx = m->wx = w.r.x;
+            m->my = m->wy = w.r.y;
+            m->mw = m->ww = w.r.w;
+            m->mh = m->wh = w.r.h;
+            updatebarpos(m);
+        }
+    }
+
+    to = want.front().m;
+    for (auto g : gone)
+    {
+        while ((c = g->clients))
+        {
+            dirty          = 1;
+            to->geomchanged = 1;
+            g->clients     = c->next;
+            detachstack(c);
+            c->mon = to;
+            attach(c);
+            attachstack(c);
+        }
+        if (g == selmon)
+            selmon = to;
+        cleanupmon(g);
+    }
+    return dirty || !gone.empty();
+}
+#endif /* XRANDR */
+
 int updategeom(void)
 {
     int dirty = 0;
 
+#ifdef XRANDR
+    if (rrevbase >= 0)
+        dirty = updaterandr();
+    else
+#endif /* XRANDR */
 #ifdef XINERAMA
     if (XineramaIsActive(display->xhandle()))
     {
@@ -2220,8 +4521,7 @@ int updategeom(void)
             XineramaQueryScreens(display->xhandle(), &nn);
         XineramaScreenInfo *unique = nullptr;
 
-        for (n = 0, m = mons; m; m = m->next, n++)
-            ;
+        n = mons.size();
         /* only consider unique geometries as separate screens */
         unique = zi::safe_calloc<XineramaScreenInfo>(nn);
         for (i = 0, j = 0; i < nn; i++)
@@ -2231,46 +4531,43 @@ int updategeom(void)
         nn = j;
         if (n <= nn)
         { /* new monitors available */
-            for (i = 0; i < (nn - n); i++)
+            for (i = n; i < nn; i++)
+                mons.push_back(createmon());
+            for (i = 0; i < nn; i++)
             {
-                for (m = mons; m && m->next; m = m->next)
-                    ;
-                if (m)
-                    m->next = createmon();
-                else
-                    mons = createmon();
-            }
-            for (i = 0, m = mons; i < nn && m; m = m->next, i++)
+                m = mons[i].get();
                 if (i >= n || unique[i].x_org != m->mx ||
                     unique[i].y_org != m->my || unique[i].width != m->mw ||
                     unique[i].height != m->mh)
                 {
-                    dirty  = 1;
-                    m->num = i;
+                    dirty          = 1;
+                    m->geomchanged = 1;
+                    m->num         = i;
                     m->mx = m->wx = unique[i].x_org;
                     m->my = m->wy = unique[i].y_org;
                     m->mw = m->ww = unique[i].width;
                     m->mh = m->wh = unique[i].height;
                     updatebarpos(m);
                 }
+            }
         }
         else
         { /* less monitors available nn < n */
             for (i = nn; i < n; i++)
             {
-                for (m = mons; m && m->next; m = m->next)
-                    ;
+                m = mons.back().get();
                 while ((c = m->clients))
                 {
                     dirty      = 1;
                     m->clients = c->next;
                     detachstack(c);
-                    c->mon = mons;
+                    c->mon              = mons.front().get();
+                    c->mon->geomchanged = 1;
                     attach(c);
                     attachstack(c);
                 }
                 if (m == selmon)
-                    selmon = mons;
+                    selmon = mons.front().get();
                 cleanupmon(m);
             }
         }
@@ -2279,19 +4576,22 @@ int updategeom(void)
     else
 #endif /* XINERAMA */
     {  /* default monitor setup */
-        if (!mons)
-            mons = createmon();
-        if (mons->mw != sw || mons->mh != sh)
+        if (mons.empty())
+            mons.push_back(createmon());
+        Monitor *m = mons.front().get();
+        if (m->mw != sw || m->mh != sh)
         {
-            dirty    = 1;
-            mons->mw = mons->ww = sw;
-            mons->mh = mons->wh = sh;
-            updatebarpos(mons);
+            dirty          = 1;
+            m->geomchanged = 1;
+            m->mw = m->ww = sw;
+            m->mh = m->wh = sh;
+            updatebarpos(m);
         }
     }
+    reindexmons();
     if (dirty)
     {
-        selmon = mons;
+        selmon = mons.front().get();
         selmon = wintomon(display->root_window());
     }
     return dirty;
@@ -2373,6 +4673,7 @@ void updatesizehints(Client *c)
         c->maxa = c->mina = 0.0;
     c->isfixed =
         (c->maxw && c->maxh && c->maxw == c->minw && c->maxh == c->minh);
+    c->userpos = (size.flags & USPosition) ? 1 : 0;
 }
 
 void updatestatus(void)
@@ -2382,12 +4683,56 @@ void updatestatus(void)
     drawbar(selmon);
 }
 
-void updatetitle(Client *c)
+/* Reads the title of c and returns whether it changed. UTF8_STRING values of
+ * _NET_WM_NAME are taken as they are, everything else goes through the locale
+ * conversion in gettextprop(). Titles are cut to at most maxtitle bytes on a
+ * codepoint boundary. */
+int updatetitle(Client *c)
+{
+    static constexpr std::size_t maxtitle = 255;
+
+    char           buf[maxtitle + 5]; /* room to finish the last codepoint */
+    Atom           type;
+    int            format;
+    unsigned long  n, extra;
+    unsigned char *p = nullptr;
+    std::size_t    len;
+    std::uint64_t  hash;
+
+    c->titlenext = zi::monotonic_ms() + 1000 / std::max(1u, titlerate);
+    if (XGetWindowProperty(display->xhandle(), c->win, netatom[NetWMName], 0L,
+                           sizeof buf / 4, false, utf8string, &type, &format,
+                           &n, &extra, &p) == Success &&
+        p && type == utf8string && format == 8 && n)
+    {
+        len = strnlen(reinterpret_cast<char *>(p),
+                      std::min<std::size_t>(n, sizeof buf - 1));
+        std::memcpy(buf, p, len);
+        buf[len] = '\0';
+    }
+    else if (!gettextprop(c->win, netatom[NetWMName], buf, sizeof buf))
+        gettextprop(c->win, XA_WM_NAME, buf, sizeof buf);
+    if (p)
+        XFree(p);
+
+    if (buf[0] == '\0') /* hack to mark broken clients */
+        strcpy(buf, broken);
+    len = strlen(buf);
+    if (len > maxtitle)
+        for (len = maxtitle; len && (buf[len] & 0xC0) == 0x80; len--)
+            ;
+    hash = zi::fnv1a(std::string_view(buf, len));
+    if (hash == c->namehash && c->name.size() == len)
+        return 0;
+    c->namehash = hash;
+    c->name.assign(buf, len);
+    updatewinindex(c);
+    return 1;
+}
+
+void updatewinindex(Client *c)
 {
-    if (!gettextprop(c->win, netatom[NetWMName], c->name, sizeof c->name))
-        gettextprop(c->win, XA_WM_NAME, c->name, sizeof c->name);
-    if (c->name[0] == '\0') /* hack to mark broken clients */
-        strcpy(c->name, broken);
+    winindex.set(c->win, c->name + " " + c->klass);
 }
 
 void updatewindowtype(Client *c)
@@ -2435,10 +4780,9 @@ void view(const Arg *arg)
 
 Client *wintoclient(Window w)
 {
-    Client  *c;
-    Monitor *m;
+    Client *c;
 
-    for (m = mons; m; m = m->next)
+    for (auto &m : mons)
         for (c = m->clients; c; c = c->next)
             if (c->win == w)
                 return c;
@@ -2447,15 +4791,14 @@ Client *wintoclient(Window w)
 
 Monitor *wintomon(Window w)
 {
-    int      x, y;
-    Client  *c;
-    Monitor *m;
+    int     x, y;
+    Client *c;
 
     if (w == display->root_window() && getrootptr(&x, &y))
         return recttomon(x, y, 1, 1);
-    for (m = mons; m; m = m->next)
+    for (auto &m : mons)
         if (w == m->barwin)
-            return m;
+            return m.get();
     if ((c = wintoclient(w)))
         return c->mon;
     return selmon;
@@ -2466,7 +4809,7 @@ Monitor *wintomon(Window w)
  * default error handler, which may call exit. */
 int xerror(Display *dpy, XErrorEvent *ee)
 {
-    if (ee->error_code == BadWindow ||
+    if (display->ignored(ee) || ee->error_code == BadWindow ||
         (ee->request_code == X_SetInputFocus && ee->error_code == BadMatch) ||
         (ee->request_code == X_PolyText8 && ee->error_code == BadDrawable) ||
         (ee->request_code == X_PolyFillRectangle &&
@@ -2482,8 +4825,6 @@ int xerror(Display *dpy, XErrorEvent *ee)
     return xerrorxlib(display->xhandle(), ee); /* may call exit */
 }
 
-int xerrordummy(Display *, XErrorEvent *) { return 0; }
-
 void zoom(const Arg *)
 {
     Client *c = selmon->sel;
@@ -2505,19 +4846,50 @@ int main(int argc, char *argv[])
     {
         zi::die("dwm-" VERSION);
     }
+    else if (argc == 2 && !std::strcmp("-p", argv[1]))
+    {
+        profiler.enable();
+    }
     else if (argc != 1)
     {
-        zi::die("usage: dwm [-v]");
+        zi::die("usage: dwm [-v] [-p]");
     }
+    /* DWM_PROFILE=file appends the startup profile to file */
+    if ((profilepath = getenv("DWM_PROFILE")) && *profilepath)
+        profiler.enable();
+    else
+        profilepath = nullptr;
+    profiler.set_counters(
+        []
+        {
+            return display ? zi::profiler::counters{display->requests(),
+                                                    display->waits()}
+                           : zi::profiler::counters{0, 0};
+        });
 
     if (!std::setlocale(LC_CTYPE, "") || !XSupportsLocale())
     {
         std::cerr << "warning: no locale support\n";
     }
 
-    display = std::make_unique<zi::display>(true);
-
-    setup();
+    /* forked while dwm is still small, see zi::spawner */
+    if (spawnhelper)
+    {
+        zi::profiler::scope s(profiler, "spawn helper");
+        launcher.start();
+    }
+    {
+        zi::profiler::scope s(profiler, "display open");
+        display = std::make_unique<zi::display>(false);
+    }
+    {
+        zi::profiler::scope s(profiler, "enforce_single");
+        display->enforce_single();
+    }
+    {
+        zi::profiler::scope s(profiler, "setup");
+        setup();
+    }
 
 #ifdef __OpenBSD__
     if (pledge("stdio rpath proc exec", nullptr) == -1)
@@ -2526,12 +4898,19 @@ int main(int argc, char *argv[])
     }
 #endif /* __OpenBSD__ */
 
-    scan();
-    runautostart();
+    {
+        zi::profiler::scope s(profiler, "scan");
+        scan();
+    }
+    {
+        zi::profiler::scope s(profiler, "runautostart");
+        runautostart();
+    }
     run();
 
     if (restart)
     {
+        savestate();
         execvp(argv[0], argv);
     }
 
@@ -0,0 +1,159 @@
+/* See LICENSE file for copyright and license details. */
+#include <sys/stat.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#include "fontcache.hpp"
+#include "util.hpp"
+
+namespace zi
+{
+
+static constexpr char const magic[] = "dwm-fontcache 1";
+
+static long long mtimeof(char const *path)
+{
+    struct stat st;
+
+    return stat(path, &st) ? -1 : static_cast<long long>(st.st_mtime);
+}
+
+static std::string homepath(char const *xdgvar, char const *fallback,
+                            char const *rest)
+{
+    char const *xdg = getenv(xdgvar), *home = getenv("HOME");
+
+    if (xdg && *xdg)
+        return std::string(xdg) + rest;
+    return home ? std::string(home) + fallback + rest : std::string();
+}
+
+/* Everything whose change can make fontconfig resolve a name differently.
+ * Directories change their mtime when files are added, removed or replaced
+ * in them, which covers fc-cache rewriting its caches after fonts were
+ * installed. */
+std::uint64_t fontcache::configstamp()
+{
+    std::string const paths[] = {
+        "/etc/fonts/fonts.conf",
+        "/etc/fonts/conf.d",
+        "/etc/fonts/local.conf",
+        homepath("XDG_CONFIG_HOME", "/.config", "/fontconfig/fonts.conf"),
+        homepath("XDG_CONFIG_HOME", "/.config", "/fontconfig/conf.d"),
+        homepath("HOME", "", "/.fonts.conf"),
+        "/usr/share/fonts",
+        "/usr/local/share/fonts",
+        homepath("XDG_DATA_HOME", "/.local/share", "/fonts"),
+        homepath("HOME", "", "/.fonts"),
+        "/var/cache/fontconfig",
+        homepath("XDG_CACHE_HOME", "/.cache", "/fontconfig"),
+    };
+    std::uint64_t h = fnv1a_seed;
+
+    for (auto const &p : paths)
+        h = fnv1a(mtimeof(p.c_str()), fnv1a(p, h));
+    return h;
+}
+
+fontcache::fontcache()
+{
+    std::ifstream in;
+    std::string   line;
+    entry         e;
+
+    path_  = homepath("XDG_CACHE_HOME", "/.cache", "/dwm/fonts");
+    stamp_ = configstamp();
+    if (path_.empty())
+        return;
+
+    /* magic, stamp, then four lines per entry */
+    in.open(path_);
+    if (!std::getline(in, line) || line != magic || !std::getline(in, line) ||
+        std::strtoull(line.c_str(), nullptr, 16) != stamp_)
+        return;
+    while (std::getline(in, e.name) && std::getline(in, e.file) &&
+           std::getline(in, line) && std::getline(in, e.pattern))
+    {
+        e.mtime = std::atoll(line.c_str());
+        entries_.push_back(e);
+    }
+}
+
+FcPattern *fontcache::lookup(char const *name) const
+{
+    for (auto const &e : entries_)
+        if (e.name == name)
+            return mtimeof(e.file.c_str()) == e.mtime
+                       ? FcNameParse(
+                             reinterpret_cast<FcChar8 const *>(e.pattern.c_str()))
+                       : nullptr;
+    return nullptr;
+}
+
+void fontcache::store(char const *name, FcPattern *match)
+{
+    FcPattern *p;
+    FcChar8   *file = nullptr, *s;
+    entry      e;
+
+    if (FcPatternGetString(match, FC_FILE, 0, &file) != FcResultMatch)
+        return;
+
+    /* charset and languages are large and recomputed from the file */
+    p = FcPatternDuplicate(match);
+    FcPatternDel(p, FC_CHARSET);
+    FcPatternDel(p, FC_LANG);
+    s = FcNameUnparse(p);
+    FcPatternDestroy(p);
+    if (!s)
+        return;
+    e = {name, reinterpret_cast<char *>(file),
+         mtimeof(reinterpret_cast<char *>(file)), reinterpret_cast<char *>(s)};
+    std::free(s);
+    if (e.pattern.find('\n') != std::string::npos)
+        return;
+
+    for (auto &o : entries_)
+        if (o.name == e.name)
+        {
+            if (o.file != e.file || o.mtime != e.mtime ||
+                o.pattern != e.pattern)
+            {
+                o      = e;
+                dirty_ = true;
+            }
+            return;
+        }
+    entries_.push_back(e);
+    dirty_ = true;
+}
+
+void fontcache::save()
+{
+    std::error_code ec;
+    std::string     tmp = path_ + ".tmp";
+    std::ofstream   out;
+
+    if (!dirty_ || path_.empty())
+        return;
+    std::filesystem::create_directories(
+        std::filesystem::path(path_).parent_path(), ec);
+    out.open(tmp, std::ios::trunc);
+    out << magic << '\n' << std::hex << stamp_ << std::dec << '\n';
+    for (auto const &e : entries_)
+        out << e.name << '\n'
+            << e.file << '\n'
+            << e.mtime << '\n'
+            << e.pattern << '\n';
+    out.close();
+    /* replaced in one step so a concurrent start never reads half a file */
+    if (out && std::rename(tmp.c_str(), path_.c_str()) == 0)
+        dirty_ = false;
+    else
+        std::remove(tmp.c_str());
+}
+
+} // namespace zi
@@ -0,0 +1,53 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <X11/Xft/Xft.h>
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace zi
+{
+
+/* What fontconfig resolved the configured font names to, kept in
+ * $XDG_CACHE_HOME/dwm/fonts so that later starts can open the fonts straight
+ * from the cached pattern without fontconfig loading its configuration and
+ * caches. The file is stamped with the modification times of the fontconfig
+ * configuration, the font directories and fontconfig's own caches, and is
+ * ignored once any of them changed; an entry is also ignored when its font
+ * file changed. */
+class fontcache
+{
+private:
+    struct entry
+    {
+        std::string name;    /* as configured */
+        std::string file;    /* FC_FILE of the match */
+        long long   mtime;   /* of file */
+        std::string pattern; /* FcNameUnparse'd match */
+    };
+
+    std::string        path_;
+    std::uint64_t      stamp_ = 0;
+    std::vector<entry> entries_;
+    bool               dirty_ = false;
+
+    static std::uint64_t configstamp();
+
+public:
+    fontcache();
+
+    /* The cached match for name as a new pattern, or null. */
+    FcPattern *lookup(char const *name) const;
+
+    /* Remembers what name resolved to. */
+    void store(char const *name, FcPattern *match);
+
+    /* Writes the cache back if anything changed. */
+    void save();
+};
+
+} // namespace zi
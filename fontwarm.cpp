@@ -0,0 +1,80 @@
+/* See LICENSE file for copyright and license details. */
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "fontwarm.hpp"
+
+namespace zi
+{
+
+fontwarmer::fontwarmer(FcPattern *base, std::vector<long> codepoints)
+{
+    if (pipe(pipe_) == 0)
+        for (int fd : pipe_)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+            fcntl(fd, F_SETFD, FD_CLOEXEC);
+        }
+    thread_ = std::thread(&fontwarmer::work, this, base, std::move(codepoints));
+}
+
+fontwarmer::~fontwarmer()
+{
+    stop_ = true;
+    if (thread_.joinable())
+        thread_.join();
+    for (auto &[cp, p] : done_)
+        FcPatternDestroy(p);
+    for (int fd : pipe_)
+        if (fd >= 0)
+            close(fd);
+}
+
+/* The same search drawable::text() does for a missing glyph, minus the
+ * display dependent substitution, which was applied to base up front. */
+void fontwarmer::work(FcPattern *base, std::vector<long> codepoints)
+{
+    for (long cp : codepoints)
+    {
+        FcCharSet *charset;
+        FcPattern *pattern, *match;
+        FcResult   result;
+
+        if (stop_)
+            break;
+        charset = FcCharSetCreate();
+        FcCharSetAddChar(charset, cp);
+        pattern = FcPatternDuplicate(base);
+        FcPatternAddCharSet(pattern, FC_CHARSET, charset);
+        FcPatternAddBool(pattern, FC_SCALABLE, FcTrue);
+        FcPatternAddBool(pattern, FC_COLOR, FcFalse);
+        FcConfigSubstitute(NULL, pattern, FcMatchPattern);
+        FcDefaultSubstitute(pattern);
+        match = FcFontMatch(NULL, pattern, &result);
+        FcCharSetDestroy(charset);
+        FcPatternDestroy(pattern);
+        if (!match)
+            continue;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_.emplace_back(cp, match);
+        }
+        if (pipe_[1] >= 0)
+            (void)!write(pipe_[1], "", 1);
+    }
+    FcPatternDestroy(base);
+}
+
+std::vector<std::pair<long, FcPattern *>> fontwarmer::take()
+{
+    std::vector<std::pair<long, FcPattern *>> ret;
+    char                                      buf[64];
+
+    while (pipe_[0] >= 0 && read(pipe_[0], buf, sizeof buf) > 0)
+        ;
+    std::lock_guard<std::mutex> lock(mutex_);
+    ret.swap(done_);
+    return ret;
+}
+
+} // namespace zi
@@ -0,0 +1,48 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <X11/Xft/Xft.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace zi
+{
+
+/* Resolves fallback fonts for a list of codepoints on a worker thread, so
+ * that the first title in a new script does not stall drawing on a
+ * fontconfig search. The worker only calls into fontconfig; the patterns it
+ * finds are handed back through take(), and fd() becomes readable whenever
+ * there is something to take. */
+class fontwarmer
+{
+private:
+    std::vector<std::pair<long, FcPattern *>> done_;
+    std::mutex                                mutex_;
+    std::atomic<bool>                         stop_ = false;
+    int                                       pipe_[2] = {-1, -1};
+    std::thread                               thread_;
+
+    fontwarmer(fontwarmer const &)            = delete;
+    fontwarmer &operator=(fontwarmer const &) = delete;
+
+    void work(FcPattern *base, std::vector<long> codepoints);
+
+public:
+    /* base is the pattern fallbacks are derived from, with the display
+     * dependent defaults already substituted; it is taken over */
+    fontwarmer(FcPattern *base, std::vector<long> codepoints);
+    ~fontwarmer();
+
+    int fd() const { return pipe_[0]; }
+
+    /* The matches found since the last call, as (codepoint, pattern); the
+     * caller owns the patterns. */
+    std::vector<std::pair<long, FcPattern *>> take();
+};
+
+} // namespace zi
@@ -0,0 +1,173 @@
+/* See LICENSE file for copyright and license details. */
+#include <algorithm>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fuzzy.hpp"
+
+namespace zi
+{
+
+static inline unsigned char fold(unsigned char c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+/* letters, digits and a few separators get a bit each, everything else
+ * shares the last one */
+static inline int charbit(unsigned char c)
+{
+    c = fold(c);
+    if (c >= 'a' && c <= 'z')
+        return c - 'a';
+    if (c >= '0' && c <= '9')
+        return 26 + c - '0';
+    switch (c)
+    {
+    case '-':
+        return 36;
+    case '_':
+        return 37;
+    case '.':
+        return 38;
+    case '+':
+        return 39;
+    case ' ':
+        return 40;
+    }
+    return 63;
+}
+
+static inline bool boundary(unsigned char c)
+{
+    return c == '-' || c == '_' || c == '.' || c == ' ' || c == '/';
+}
+
+std::uint64_t fuzzy_filter::charmask(std::string_view s)
+{
+    std::uint64_t m = 0;
+
+    for (unsigned char c : s)
+        m |= std::uint64_t(1) << charbit(c);
+    return m;
+}
+
+int fuzzy_filter::score(std::string_view query, std::string_view item)
+{
+    std::size_t qi = 0, ci;
+    long        prev = -2;
+    int         s    = 0;
+
+    for (ci = 0; ci < item.size() && qi < query.size(); ci++)
+    {
+        if (fold(item[ci]) != fold(query[qi]))
+            continue;
+        s += 16;
+        if (long(ci) == prev + 1)
+            s += 24;
+        if (ci == 0)
+            s += 32;
+        else if (boundary(item[ci - 1]))
+            s += 20;
+        prev = ci;
+        qi++;
+    }
+    if (qi < query.size())
+        return -1;
+    /* a match never scores below zero, which means no match */
+    return std::max(
+        0, s - static_cast<int>(std::min<std::size_t>(item.size(), 64)));
+}
+
+/* pass[i] = masks[i] has every bit of want, two masks per step where SSE2 is
+ * there. SSE2 has no 64 bit compare, so both 32 bit halves have to be zero. */
+static void prefilter(std::uint64_t want, std::uint64_t const *masks,
+                      std::uint8_t *pass, std::size_t n)
+{
+    std::size_t i = 0;
+
+#ifdef __SSE2__
+    __m128i const w    = _mm_set1_epi64x(static_cast<long long>(want));
+    __m128i const zero = _mm_setzero_si128();
+
+    for (; i + 2 <= n; i += 2)
+    {
+        __m128i v, z;
+        int     b;
+
+        v = _mm_loadu_si128(reinterpret_cast<__m128i const *>(masks + i));
+        z = _mm_cmpeq_epi32(_mm_andnot_si128(v, w), zero);
+        z = _mm_and_si128(z, _mm_shuffle_epi32(z, _MM_SHUFFLE(2, 3, 0, 1)));
+        b = _mm_movemask_pd(_mm_castsi128_pd(z));
+        pass[i]     = b & 1;
+        pass[i + 1] = b >> 1;
+    }
+#endif
+    for (; i < n; i++)
+        pass[i] = (want & ~masks[i]) == 0;
+}
+
+void fuzzy_filter::assign(std::vector<std::string> const &items)
+{
+    items_ = &items;
+    masks_.resize(items.size());
+    pass_.resize(items.size());
+    for (std::size_t i = 0; i < items.size(); i++)
+        masks_[i] = charmask(items[i]);
+    scores_.assign(items.size(), 0);
+    matches_.clear();
+    query_.clear();
+    for (std::uint32_t i = 0; i < items.size(); i++)
+        matches_.push_back(i);
+}
+
+std::vector<std::uint32_t> const &
+fuzzy_filter::update(std::string_view query)
+{
+    std::vector<std::uint32_t> &m    = matches_;
+    std::uint64_t               want = charmask(query);
+    std::size_t                 n    = 0;
+
+    if (!items_)
+        return matches_;
+    /* a longer query can only match a subset of what the shorter matched */
+    if (!query.starts_with(query_))
+    {
+        m.resize(items_->size());
+        for (std::uint32_t i = 0; i < m.size(); i++)
+            m[i] = i;
+    }
+    query_ = query;
+
+    /* the masks are tested in one sweep over the packed array, the matches
+     * are then narrowed down without a branch on the outcome */
+    prefilter(want, masks_.data(), pass_.data(), masks_.size());
+    for (std::size_t i = 0; i < m.size(); i++)
+    {
+        m[n] = m[i];
+        n += pass_[m[i]];
+    }
+    m.resize(n);
+
+    n = 0;
+    for (std::size_t i = 0; i < m.size(); i++)
+        if ((scores_[m[i]] = score(query, (*items_)[m[i]])) >= 0)
+            m[n++] = m[i];
+    m.resize(n);
+
+    std::sort(m.begin(), m.end(),
+              [this](std::uint32_t a, std::uint32_t b)
+              {
+                  auto const &x = (*items_)[a];
+                  auto const &y = (*items_)[b];
+                  if (scores_[a] != scores_[b])
+                      return scores_[a] > scores_[b];
+                  if (x.size() != y.size())
+                      return x.size() < y.size();
+                  return x < y;
+              });
+    return m;
+}
+
+} // namespace zi
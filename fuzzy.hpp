@@ -0,0 +1,44 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace zi
+{
+
+/* Fuzzy filtering of a fixed list of strings as a query is typed. A query
+ * matches an item when its characters appear in the item in order, ignoring
+ * case. Each item carries a 64 bit mask of the characters in it, so most
+ * items are rejected with one and-not over a packed array of masks before
+ * the subsequence is looked for; matches are ranked by score(). When the
+ * query only grew, just the previous matches are looked at again. */
+class fuzzy_filter
+{
+private:
+    std::vector<std::string> const *items_ = nullptr;
+    std::vector<std::uint64_t>      masks_;
+    std::vector<std::uint8_t>       pass_; /* masks_ test, indexed like items */
+    std::vector<std::uint32_t>      matches_;
+    std::vector<int>                scores_; /* indexed like items */
+    std::string                     query_;
+
+public:
+    static std::uint64_t charmask(std::string_view s);
+
+    /* Higher is better, -1 if query is not a subsequence of item. Matches
+     * at the start of the item or of a word and runs of consecutive
+     * characters score higher, longer items lower. */
+    static int score(std::string_view query, std::string_view item);
+
+    /* items must outlive the filter or the next assign() */
+    void assign(std::vector<std::string> const &items);
+
+    /* Indices of the items matching query, best first. */
+    std::vector<std::uint32_t> const &update(std::string_view query);
+};
+
+} // namespace zi
@@ -0,0 +1,132 @@
+/* See LICENSE file for copyright and license details. */
+#include <dirent.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#include <algorithm>
+
+#include "pathindex.hpp"
+
+namespace zi
+{
+
+path_index::path_index(const char *path)
+{
+    const char *p, *q;
+
+    if (!path || !*path)
+        path = "/usr/local/bin:/usr/bin:/bin";
+    for (p = path;; p = q + 1)
+    {
+        if (!(q = strchr(p, ':')))
+            q = p + strlen(p);
+        /* an empty entry is the current directory */
+        dirs_.emplace_back(p == q ? std::string(".") : std::string(p, q));
+        if (!*q)
+            break;
+    }
+    mtimes_.assign(dirs_.size(), 0);
+#ifdef __linux__
+    if ((inotify_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) >= 0)
+        for (auto const &d : dirs_)
+            inotify_add_watch(inotify_, d.c_str(),
+                              IN_CREATE | IN_DELETE | IN_MOVED_FROM |
+                                  IN_MOVED_TO | IN_ATTRIB | IN_DELETE_SELF |
+                                  IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+}
+
+path_index::~path_index()
+{
+    if (inotify_ >= 0)
+        close(inotify_);
+}
+
+void path_index::revalidate()
+{
+    char        buf[4096];
+    struct stat sb;
+
+    if (inotify_ >= 0)
+    {
+        /* any event, an overflow included, means something changed */
+        while (read(inotify_, buf, sizeof buf) > 0)
+            stale_ = true;
+        return;
+    }
+    for (std::size_t i = 0; i < dirs_.size(); i++)
+    {
+        std::time_t m = stat(dirs_[i].c_str(), &sb) ? 0 : sb.st_mtime;
+        if (m != mtimes_[i])
+        {
+            mtimes_[i] = m;
+            stale_     = true;
+        }
+    }
+}
+
+/* Earlier directories win, as with execvp. */
+void path_index::rebuild()
+{
+    DIR           *dir;
+    struct dirent *de;
+    struct stat    sb;
+
+    paths_.clear();
+    for (auto const &d : dirs_)
+    {
+        if (!(dir = opendir(d.c_str())))
+            continue;
+        while ((de = readdir(dir)))
+        {
+            if (de->d_type == DT_DIR || paths_.count(de->d_name))
+                continue;
+            if (fstatat(dirfd(dir), de->d_name, &sb, 0) ||
+                !S_ISREG(sb.st_mode) ||
+                faccessat(dirfd(dir), de->d_name, X_OK, 0))
+                continue;
+            paths_.emplace(de->d_name, d + "/" + de->d_name);
+        }
+        closedir(dir);
+    }
+    stale_  = false;
+    resort_ = true;
+}
+
+const char *path_index::lookup(const char *name)
+{
+    if (strchr(name, '/'))
+        return name;
+    revalidate();
+    if (stale_)
+        rebuild();
+    auto it = paths_.find(name);
+    return it == paths_.end() ? nullptr : it->second.c_str();
+}
+
+std::vector<std::string> const &path_index::names()
+{
+    refresh();
+    return names_;
+}
+
+bool path_index::refresh()
+{
+    revalidate();
+    if (stale_)
+        rebuild();
+    if (!resort_)
+        return false;
+    names_.clear();
+    for (auto const &[name, path] : paths_)
+        names_.push_back(name);
+    std::sort(names_.begin(), names_.end());
+    resort_ = false;
+    return true;
+}
+
+} // namespace zi
@@ -0,0 +1,54 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace zi
+{
+
+/* The executables reachable through $PATH, so that starting a program does
+ * not search the directories each time. The index is rebuilt on the first
+ * lookup after one of the directories changed, which inotify reports where
+ * available; elsewhere the directory mtimes are compared on every lookup.
+ * The sorted list of names only changes in names() and refresh(), so a
+ * reference to it stays valid across lookups. */
+class path_index
+{
+private:
+    std::vector<std::string>                     dirs_;
+    std::vector<std::time_t>                     mtimes_;
+    std::unordered_map<std::string, std::string> paths_; /* name -> path */
+    std::vector<std::string>                     names_; /* sorted */
+    bool                                         stale_   = true;
+    bool                                         resort_  = true;
+    int                                          inotify_ = -1;
+
+    path_index(path_index const &)            = delete;
+    path_index &operator=(path_index const &) = delete;
+
+    void revalidate();
+    void rebuild();
+
+public:
+    explicit path_index(const char *path);
+    ~path_index();
+
+    /* The file name would be run as, NULL if there is no such program.
+     * Names containing a slash are returned as they are. */
+    const char *lookup(const char *name);
+
+    /* Every program name, sorted. */
+    std::vector<std::string> const &names();
+
+    /* Readable when a directory changed, -1 without inotify. */
+    int fd() const { return inotify_; }
+
+    /* Brings the index and names() up to date; true if the names changed. */
+    bool refresh();
+};
+
+} // namespace zi
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <X11/Xft/Xft.h>
+#include <X11/Xlib.h>
+
+namespace zi
+{
+
+/* Off-screen surface of a fixed size, such as the backing store of one bar.
+ * The Xft draw on top of it is only created the first time text is drawn and
+ * then kept for the lifetime of the pixmap. */
+class pixmap
+{
+private:
+    Display     *dpy_;
+    int          screen_;
+    Pixmap       xpixmap_;
+    unsigned int w_, h_;
+    XftDraw     *xftdraw_ = nullptr;
+
+    pixmap(pixmap const &) = delete;
+    pixmap(pixmap &&)      = delete;
+
+    pixmap &operator=(pixmap const &) = delete;
+    pixmap &operator=(pixmap &&) = delete;
+
+public:
+    pixmap(Display *dpy, int screen, Drawable d, unsigned int w,
+           unsigned int h)
+        : dpy_(dpy)
+        , screen_(screen)
+        , xpixmap_(XCreatePixmap(dpy, d, w, h, DefaultDepth(dpy, screen)))
+        , w_(w)
+        , h_(h)
+    {
+    }
+
+    ~pixmap()
+    {
+        if (xftdraw_)
+            XftDrawDestroy(xftdraw_);
+        XFreePixmap(dpy_, xpixmap_);
+    }
+
+    Pixmap xhandle() const { return xpixmap_; }
+
+    unsigned int width() const { return w_; }
+    unsigned int height() const { return h_; }
+
+    XftDraw *xftdraw()
+    {
+        if (!xftdraw_)
+            xftdraw_ = XftDrawCreate(dpy_, xpixmap_,
+                                     DefaultVisual(dpy_, screen_),
+                                     DefaultColormap(dpy_, screen_));
+        return xftdraw_;
+    }
+};
+
+} // namespace zi
@@ -0,0 +1,113 @@
+/* See LICENSE file for copyright and license details. */
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#include "place.hpp"
+
+namespace zi
+{
+
+static long dist2(int x, int y, int px, int py)
+{
+    long dx = x - px, dy = y - py;
+    return dx * dx + dy * dy;
+}
+
+rect place(rect const &area, int w, int h, std::vector<rect> const &taken,
+           int px, int py)
+{
+    struct edge
+    {
+        int         x;
+        int         sign;
+        std::size_t i;
+    };
+
+    std::size_t const n    = taken.size();
+    int const         xmax = area.x + area.w - w, ymax = area.y + area.h - h;
+    rect              ret  = {area.x, area.y, w, h};
+    std::vector<int>  ys;
+    std::vector<long> vy(n + 1);
+    std::vector<edge> edges;
+    long              best = LONG_MAX, bestd = LONG_MAX;
+
+    if (xmax < area.x || ymax < area.y)
+    {
+        ret.x = xmax < area.x ? area.x : std::clamp(px, area.x, xmax);
+        ret.y = ymax < area.y ? area.y : std::clamp(py, area.y, ymax);
+        return ret;
+    }
+
+    /* Horizontal overlap with an obstacle rises from t.x - w, is flat while
+     * one contains the other and drops back to zero at t.x + t.w. The sum
+     * over a row is piecewise linear, so its minimum is at a point where the
+     * slope increases, at the area bounds or at the preferred position; the
+     * latter three are probes that belong to no obstacle (index n). */
+    edges.reserve(4 * n + 3);
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        rect const &t = taken[i];
+        edges.push_back({t.x - w, 1, i});
+        edges.push_back({std::min(t.x, t.x + t.w - w), -1, i});
+        edges.push_back({std::max(t.x, t.x + t.w - w), -1, i});
+        edges.push_back({t.x + t.w, 1, i});
+    }
+    edges.push_back({area.x, 0, n});
+    edges.push_back({std::clamp(px, area.x, xmax), 0, n});
+    edges.push_back({xmax, 0, n});
+    std::sort(edges.begin(), edges.end(),
+              [](auto const &a, auto const &b) { return a.x < b.x; });
+
+    /* the same holds vertically for the candidate rows */
+    ys.assign({area.y, ymax, std::clamp(py, area.y, ymax)});
+    for (auto const &t : taken)
+        for (int y : {t.y - h, t.y + t.h})
+            if (y >= area.y && y <= ymax)
+                ys.push_back(y);
+    std::sort(ys.begin(), ys.end());
+    ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+    /* rows closest to the preferred position first, so that once a free spot
+     * is known the remaining rows can be skipped */
+    std::stable_sort(ys.begin(), ys.end(), [py](int a, int b)
+                     { return std::abs(a - py) < std::abs(b - py); });
+
+    vy[n] = 1;
+    for (int y : ys)
+    {
+        if (best == 0 && dist2(px, y, px, py) >= bestd)
+            break;
+
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            rect const &t = taken[i];
+            vy[i]         = std::max(
+                0, std::min(y + h, t.y + t.h) - std::max(y, t.y));
+        }
+
+        /* edges of obstacles outside the row do not change the slope, which
+         * keeps this loop free of unpredictable branches */
+        long value = 0, slope = 0;
+        int  at    = area.x;
+        for (auto const &e : edges)
+        {
+            value += slope * (e.x - at);
+            at = e.x;
+            slope += e.sign * vy[e.i];
+            if (value > best || e.sign < 0 || e.x < area.x || e.x > xmax)
+                continue;
+            long d = dist2(e.x, y, px, py);
+            if (value < best || (value == best && d < bestd))
+            {
+                best  = value;
+                bestd = d;
+                ret.x = e.x;
+                ret.y = y;
+            }
+        }
+    }
+    return ret;
+}
+
+} // namespace zi
@@ -0,0 +1,20 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include "util.hpp"
+
+#include <vector>
+
+namespace zi
+{
+
+/* Picks a position for a w x h window inside area that overlaps the taken
+ * rectangles as little as possible, preferring the spot closest to (px, py).
+ * Candidate rows are swept left to right over the sorted obstacle edges while
+ * keeping the running overlap, so the free stretches of a row are the ones
+ * where it stays at zero. */
+rect place(rect const &area, int w, int h, std::vector<rect> const &taken,
+           int px, int py);
+
+} // namespace zi
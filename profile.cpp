@@ -0,0 +1,74 @@
+/* See LICENSE file for copyright and license details. */
+#include <chrono>
+
+#include "profile.hpp"
+
+namespace zi
+{
+
+long long profiler::now() const
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+               .count() -
+           epoch_;
+}
+
+profiler::counters profiler::count() const
+{
+    return counters_ ? counters_() : counters{0, 0};
+}
+
+void profiler::enable()
+{
+    enabled_ = true;
+    epoch_   = 0;
+    epoch_   = now();
+}
+
+std::size_t profiler::begin(const char *name)
+{
+    if (!enabled_)
+        return 0;
+    samples_.push_back({name, depth_++, now(), -1, count(), {0, 0}});
+    return samples_.size() - 1;
+}
+
+void profiler::end(std::size_t i)
+{
+    if (!enabled_)
+        return;
+    samples_[i].end   = now();
+    samples_[i].after = count();
+    depth_--;
+}
+
+void profiler::mark(const char *name)
+{
+    long long t = now();
+    counters  c = count();
+
+    if (enabled_)
+        samples_.push_back({name, depth_, t, t, c, c});
+}
+
+void profiler::report(std::FILE *out) const
+{
+    if (!enabled_ || !out)
+        return;
+    std::fprintf(out, "dwm startup profile\n%-32s %10s %10s %8s %6s\n",
+                 "phase", "at ms", "took ms", "requests", "waits");
+    for (auto const &s : samples_)
+    {
+        bool done = s.end >= 0; /* ended before the report */
+
+        std::fprintf(out, "%*s%-*s %10.3f %10.3f %8lu %6lu\n", 2 * s.depth, "",
+                     32 - 2 * s.depth, s.name, s.start / 1000.0,
+                     done ? (s.end - s.start) / 1000.0 : 0.0,
+                     done ? s.after.requests - s.before.requests : 0,
+                     done ? s.after.waits - s.before.waits : 0);
+    }
+    std::fflush(out);
+}
+
+} // namespace zi
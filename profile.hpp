@@ -0,0 +1,77 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <cstdio>
+#include <functional>
+#include <vector>
+
+namespace zi
+{
+
+/* Opt-in startup trace. Phases are timed with scopes, which nest, and each
+ * one also records how many X requests it sent and how many times it had to
+ * wait for the server, as reported by the counters callback. Disabled, a
+ * scope costs a branch. */
+class profiler
+{
+public:
+    struct counters
+    {
+        unsigned long requests; /* requests sent so far */
+        unsigned long waits;    /* blocking round trips so far */
+    };
+
+private:
+    struct sample
+    {
+        const char *name;
+        int         depth;
+        long long   start, end; /* microseconds since enable() */
+        counters    before, after;
+    };
+
+    bool                      enabled_ = false;
+    long long                 epoch_   = 0;
+    int                       depth_   = 0;
+    std::vector<sample>       samples_;
+    std::function<counters()> counters_;
+
+    long long now() const;
+    counters  count() const;
+
+public:
+    class scope
+    {
+    private:
+        profiler   &p_;
+        std::size_t i_;
+
+        scope(scope const &)            = delete;
+        scope &operator=(scope const &) = delete;
+
+    public:
+        scope(profiler &p, const char *name)
+            : p_(p)
+            , i_(p.begin(name))
+        {
+        }
+
+        ~scope() { p_.end(i_); }
+    };
+
+    void enable();
+    bool enabled() const { return enabled_; }
+
+    void set_counters(std::function<counters()> fn) { counters_ = fn; }
+
+    std::size_t begin(const char *name);
+    void        end(std::size_t i);
+
+    /* records a point in time, such as the first event handled */
+    void mark(const char *name);
+
+    void report(std::FILE *out) const;
+};
+
+} // namespace zi
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "util.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace zi
+{
+
+/* Index over the committed geometry of the clients on one monitor.
+ *
+ * Entries are inserted in stacking order (topmost first) and then build() is
+ * called once; queries never touch the X server. Point lookups go through a
+ * uniform grid of roughly sqrt(n) x sqrt(n) cells, directional lookups
+ * binary search the entries sorted by their centre along the travel axis and
+ * stop as soon as the remaining candidates can no longer beat the best one. */
+template <typename T>
+class spatial_index
+{
+private:
+    struct entry
+    {
+        T    value;
+        rect r;
+    };
+
+    std::vector<entry>         entries_;
+    std::vector<std::uint32_t> byx_, byy_;
+
+    int                                     halfw_ = 0, halfh_ = 0;
+    rect                                    bounds_ = {0, 0, 0, 0};
+    int                                     cols_ = 0, rows_ = 0;
+    int                                     cellw_ = 1, cellh_ = 1;
+    std::vector<std::vector<std::uint32_t>> cells_;
+
+    int cellx(int x) const
+    {
+        return std::clamp((x - bounds_.x) / cellw_, 0, cols_ - 1);
+    }
+
+    int celly(int y) const
+    {
+        return std::clamp((y - bounds_.y) / cellh_, 0, rows_ - 1);
+    }
+
+public:
+    void clear()
+    {
+        entries_.clear();
+        byx_.clear();
+        byy_.clear();
+        cells_.clear();
+        cols_ = rows_ = 0;
+    }
+
+    bool empty() const { return entries_.empty(); }
+
+    void insert(T value, rect const &r) { entries_.push_back({value, r}); }
+
+    void build()
+    {
+        std::uint32_t n = entries_.size();
+
+        byx_.resize(n);
+        byy_.resize(n);
+        for (std::uint32_t i = 0; i < n; ++i)
+            byx_[i] = byy_[i] = i;
+        std::sort(byx_.begin(), byx_.end(),
+                  [this](auto a, auto b)
+                  { return entries_[a].r.cx() < entries_[b].r.cx(); });
+        std::sort(byy_.begin(), byy_.end(),
+                  [this](auto a, auto b)
+                  { return entries_[a].r.cy() < entries_[b].r.cy(); });
+
+        cells_.clear();
+        if (!n)
+        {
+            cols_ = rows_ = 0;
+            return;
+        }
+
+        int x0 = entries_[0].r.x, y0 = entries_[0].r.y;
+        int x1 = x0 + entries_[0].r.w, y1 = y0 + entries_[0].r.h;
+        halfw_ = halfh_ = 0;
+        for (auto const &e : entries_)
+        {
+            halfw_ = std::max(halfw_, (e.r.w + 1) / 2);
+            halfh_ = std::max(halfh_, (e.r.h + 1) / 2);
+            x0     = std::min(x0, e.r.x);
+            y0 = std::min(y0, e.r.y);
+            x1 = std::max(x1, e.r.x + e.r.w);
+            y1 = std::max(y1, e.r.y + e.r.h);
+        }
+        bounds_ = {x0, y0, std::max(1, x1 - x0), std::max(1, y1 - y0)};
+        cols_ = rows_ = std::max(1, static_cast<int>(std::sqrt(n)));
+        cellw_        = std::max(1, (bounds_.w + cols_ - 1) / cols_);
+        cellh_        = std::max(1, (bounds_.h + rows_ - 1) / rows_);
+        cells_.resize(cols_ * rows_);
+
+        for (std::uint32_t i = 0; i < n; ++i)
+        {
+            rect const &r = entries_[i].r;
+            for (int cy = celly(r.y); cy <= celly(r.y + r.h - 1); ++cy)
+                for (int cx = cellx(r.x); cx <= cellx(r.x + r.w - 1); ++cx)
+                    cells_[cy * cols_ + cx].push_back(i);
+        }
+    }
+
+    /* Topmost entry containing the point, or def. */
+    T at(int x, int y, T def = T{}) const
+    {
+        if (!cols_ || !bounds_.contains(x, y))
+            return def;
+        for (auto i : cells_[celly(y) * cols_ + cellx(x)])
+            if (entries_[i].r.contains(x, y))
+                return entries_[i].value;
+        return def;
+    }
+
+    /* Closest entry accepted by pred whose centre lies strictly in direction
+     * (dx, dy) from r, where exactly one of dx, dy is +1 or -1. The distance
+     * between facing edges is weighed against the gap on the other axis, so
+     * a neighbour that lines up with r wins over a slightly closer one that
+     * does not. */
+    template <typename Pred>
+    T nearest(rect const &r, int dx, int dy, Pred pred, T def = T{}) const
+    {
+        bool const horiz = dx != 0;
+        int const  dir   = horiz ? dx : dy;
+        auto const &order = horiz ? byx_ : byy_;
+        int const  from   = horiz ? r.cx() : r.cy();
+
+        auto centre = [&](std::uint32_t i)
+        { return horiz ? entries_[i].r.cx() : entries_[i].r.cy(); };
+
+        auto edge = [&](rect const &c)
+        {
+            int lo = horiz ? r.x : r.y, hi = lo + (horiz ? r.w : r.h);
+            int clo = horiz ? c.x : c.y, chi = clo + (horiz ? c.w : c.h);
+            return std::max(0, dir > 0 ? clo - hi : lo - chi);
+        };
+
+        auto gap = [&](rect const &c)
+        {
+            int lo = horiz ? r.y : r.x, hi = lo + (horiz ? r.h : r.w);
+            int clo = horiz ? c.y : c.x, chi = clo + (horiz ? c.h : c.w);
+            int ov  = std::min(hi, chi) - std::max(lo, clo);
+            return ov > 0 ? 0 : 1 - ov;
+        };
+
+        /* no entry further than this along the axis can have a closer edge */
+        long const slack = (horiz ? halfw_ + r.w / 2 : halfh_ + r.h / 2) + 1;
+
+        /* first candidate past the centre of r in the direction of travel */
+        long pos, end, step = dir > 0 ? 1 : -1;
+        if (dir > 0)
+        {
+            pos = std::upper_bound(order.begin(), order.end(), from,
+                                   [&](int v, std::uint32_t i)
+                                   { return v < centre(i); }) -
+                  order.begin();
+            end = order.size();
+        }
+        else
+        {
+            pos = std::lower_bound(order.begin(), order.end(), from,
+                                   [&](std::uint32_t i, int v)
+                                   { return centre(i) < v; }) -
+                  order.begin() - 1;
+            end = -1;
+        }
+
+        long best = std::numeric_limits<long>::max(), bestoff = 0;
+        T    ret  = def;
+        for (; pos != end; pos += step)
+        {
+            auto const &e    = entries_[order[pos]];
+            long        dist = std::labs(centre(order[pos]) - from);
+            if (dist - slack > best)
+                break;
+            if (!pred(e.value))
+                continue;
+            long score = edge(e.r) + 2L * gap(e.r);
+            long off   = horiz ? std::labs(e.r.cy() - r.cy())
+                               : std::labs(e.r.cx() - r.cx());
+            if (score < best || (score == best && off < bestoff))
+            {
+                best    = score;
+                bestoff = off;
+                ret     = e.value;
+            }
+        }
+        return ret;
+    }
+};
+
+/* Index over a handful of mostly static rectangles such as the monitors.
+ *
+ * The distinct left/right and top/bottom edges cut the plane into a grid whose
+ * cells list the rectangles covering them. A point lookup is two binary
+ * searches plus one cell; a rectangle lookup visits only the cells it spans. */
+template <typename T>
+class region_index
+{
+private:
+    std::vector<T>                          values_;
+    std::vector<int>                        xs_, ys_;
+    std::vector<std::vector<std::uint32_t>> cells_;
+    mutable std::vector<std::uint32_t>      seen_;
+    mutable std::uint32_t                   stamp_ = 0;
+
+    static int slot(std::vector<int> const &edges, int v)
+    {
+        return std::upper_bound(edges.begin(), edges.end(), v) -
+               edges.begin() - 1;
+    }
+
+    std::size_t cols() const { return xs_.size() - 1; }
+
+public:
+    void clear()
+    {
+        values_.clear();
+        xs_.clear();
+        ys_.clear();
+        cells_.clear();
+        seen_.clear();
+    }
+
+    void build(std::vector<std::pair<T, rect>> const &regions)
+    {
+        clear();
+        for (auto const &[v, r] : regions)
+        {
+            values_.push_back(v);
+            xs_.insert(xs_.end(), {r.x, r.x + r.w});
+            ys_.insert(ys_.end(), {r.y, r.y + r.h});
+        }
+        std::sort(xs_.begin(), xs_.end());
+        xs_.erase(std::unique(xs_.begin(), xs_.end()), xs_.end());
+        std::sort(ys_.begin(), ys_.end());
+        ys_.erase(std::unique(ys_.begin(), ys_.end()), ys_.end());
+        if (xs_.size() < 2 || ys_.size() < 2)
+            return;
+
+        cells_.resize(cols() * (ys_.size() - 1));
+        for (std::uint32_t i = 0; i < regions.size(); ++i)
+        {
+            rect const &r = regions[i].second;
+            for (int y = slot(ys_, r.y); ys_[y] < r.y + r.h; ++y)
+                for (int x = slot(xs_, r.x); xs_[x] < r.x + r.w; ++x)
+                    cells_[y * cols() + x].push_back(i);
+        }
+        seen_.assign(values_.size(), 0);
+        stamp_ = 0;
+    }
+
+    /* First region containing the point, or def. */
+    T at(int x, int y, T def = T{}) const
+    {
+        int cx = slot(xs_, x), cy = slot(ys_, y);
+
+        if (cells_.empty() || cx < 0 || cy < 0 ||
+            std::size_t(cx) >= cols() || std::size_t(cy) >= ys_.size() - 1)
+            return def;
+        auto const &cell = cells_[cy * cols() + cx];
+        return cell.empty() ? def : values_[cell.front()];
+    }
+
+    /* Calls fn once for every region intersecting r. */
+    template <typename Fn>
+    void overlapping(rect const &r, Fn fn) const
+    {
+        if (cells_.empty() || r.w <= 0 || r.h <= 0)
+            return;
+        int x0 = std::max(0, slot(xs_, r.x));
+        int y0 = std::max(0, slot(ys_, r.y));
+        int x1 = std::min<int>(cols() - 1, slot(xs_, r.x + r.w - 1));
+        int y1 = std::min<int>(ys_.size() - 2, slot(ys_, r.y + r.h - 1));
+
+        if (!++stamp_)
+        {
+            std::fill(seen_.begin(), seen_.end(), 0);
+            stamp_ = 1;
+        }
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                for (auto i : cells_[y * cols() + x])
+                    if (seen_[i] != stamp_)
+                    {
+                        seen_[i] = stamp_;
+                        fn(values_[i]);
+                    }
+    }
+};
+
+} // namespace zi
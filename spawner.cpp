@@ -0,0 +1,120 @@
+/* See LICENSE file for copyright and license details. */
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "spawner.hpp"
+
+extern char **environ;
+
+namespace zi
+{
+
+/* One request is one datagram: a flag byte asking for a reply, the path and
+ * then the arguments, each terminated by a nul byte. */
+static const std::size_t maxrequest = 64 * 1024;
+
+spawner::~spawner()
+{
+    if (sock_ >= 0)
+        close(sock_);
+}
+
+bool spawner::start()
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv))
+        return false;
+    switch (pid_ = fork())
+    {
+    case -1:
+        close(sv[0]);
+        close(sv[1]);
+        return false;
+    case 0:
+        close(sv[0]);
+        serve(sv[1]);
+    }
+    close(sv[1]);
+    fcntl(sv[0], F_SETFD, FD_CLOEXEC);
+    sock_ = sv[0];
+    return true;
+}
+
+void spawner::serve(int sock)
+{
+    static char         buf[maxrequest];
+    std::vector<char *> argv;
+    posix_spawnattr_t   attr;
+    sigset_t            dfl;
+    pid_t               pid;
+    ssize_t             n;
+    int                 err;
+    char               *p;
+
+    /* the children are left to init, their exit status is of no interest */
+    signal(SIGCHLD, SIG_IGN);
+    sigemptyset(&dfl);
+    sigaddset(&dfl, SIGCHLD);
+    posix_spawnattr_init(&attr);
+    posix_spawnattr_setsigdefault(&attr, &dfl);
+#ifdef POSIX_SPAWN_SETSID
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGDEF);
+#else
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+#endif
+    while ((n = recv(sock, buf, sizeof buf, 0)) > 0 || (n < 0 && errno == EINTR))
+    {
+        if (n < 3 || buf[n - 1])
+            continue;
+        argv.clear();
+        for (p = buf + 1 + strlen(buf + 1) + 1; p < buf + n; p += strlen(p) + 1)
+            argv.push_back(p);
+        argv.push_back(nullptr);
+        if ((err = posix_spawn(&pid, buf + 1, nullptr, &attr, argv.data(),
+                               environ)))
+            fprintf(stderr, "dwm: cannot start %s: %s\n", buf + 1,
+                    strerror(err));
+        if (buf[0])
+            send(sock, &err, sizeof err, MSG_NOSIGNAL);
+    }
+    _exit(0);
+}
+
+int spawner::spawn(const char *path, const char *const argv[], bool wait)
+{
+    std::string req(1, wait ? 1 : 0);
+    ssize_t     n   = 0;
+    int         err = 0;
+
+    if (sock_ < 0)
+        return -1;
+    req.append(path).push_back('\0');
+    for (; *argv; argv++)
+        req.append(*argv).push_back('\0');
+    if (req.size() > maxrequest)
+        return -1;
+    if (send(sock_, req.data(), req.size(), MSG_NOSIGNAL) < 0)
+        n = -1;
+    else if (wait)
+        while ((n = recv(sock_, &err, sizeof err, 0)) < 0 && errno == EINTR)
+            ;
+    if (n < 0 || (wait && n != sizeof err))
+    {
+        close(sock_);
+        sock_ = -1;
+        return -1;
+    }
+    return err;
+}
+
+} // namespace zi
@@ -0,0 +1,41 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <sys/types.h>
+
+namespace zi
+{
+
+/* A small process forked before the window manager has grown, which starts
+ * programs on its behalf, so that the cost of a launch does not depend on
+ * how much memory the window manager holds. Requests go over a socketpair;
+ * the helper exits when its end is closed, including on exec. Programs
+ * started this way are children of the helper, which reaps them. */
+class spawner
+{
+private:
+    int   sock_ = -1;
+    pid_t pid_  = -1;
+
+    spawner(spawner const &)            = delete;
+    spawner &operator=(spawner const &) = delete;
+
+    [[noreturn]] static void serve(int sock);
+
+public:
+    spawner() = default;
+    ~spawner();
+
+    bool start();
+    bool running() const { return sock_ >= 0; }
+    pid_t pid() const { return pid_; }
+
+    /* Has the helper run path with argv. With wait set, blocks until the
+     * helper has started the program and returns its error, 0 on success;
+     * otherwise returns 0 once the request is sent. -1 means the helper is
+     * gone and the caller has to start the program itself. */
+    int spawn(const char *path, const char *const argv[], bool wait);
+};
+
+} // namespace zi
@@ -0,0 +1,169 @@
+/* See LICENSE file for copyright and license details. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace zi
+{
+
+/* Substring search over a changing set of short texts, such as the titles
+ * of all clients.
+ *
+ * Every text is indexed under the trigrams (three byte sequences, ASCII
+ * letters folded to lower case) it contains. A query matches the texts that
+ * contain each of its space separated words; the words of three bytes or
+ * more narrow the candidates down to the shortest posting list among their
+ * trigrams, and only those candidates are compared against the words.
+ * Replacing a text only touches the posting lists of the trigrams that
+ * appeared or disappeared. */
+template <typename K>
+class trigram_index
+{
+private:
+    struct doc
+    {
+        std::string                text;  /* folded */
+        std::vector<std::uint32_t> grams; /* sorted, unique */
+    };
+
+    std::unordered_map<K, doc>                        docs_;
+    std::unordered_map<std::uint32_t, std::vector<K>> postings_;
+
+    static std::string fold(std::string_view s)
+    {
+        std::string r(s);
+        for (auto &c : r)
+            if (c >= 'A' && c <= 'Z')
+                c |= 0x20;
+        return r;
+    }
+
+    static void grams(std::string_view s, std::vector<std::uint32_t> &out)
+    {
+        out.clear();
+        for (std::size_t i = 0; i + 3 <= s.size(); ++i)
+            out.push_back(std::uint32_t(std::uint8_t(s[i])) << 16 |
+                          std::uint32_t(std::uint8_t(s[i + 1])) << 8 |
+                          std::uint8_t(s[i + 2]));
+        std::sort(out.begin(), out.end());
+        out.erase(std::unique(out.begin(), out.end()), out.end());
+    }
+
+    void unpost(std::uint32_t g, K key)
+    {
+        auto it = postings_.find(g);
+        if (it == postings_.end())
+            return;
+        auto &v = it->second;
+        auto  p = std::find(v.begin(), v.end(), key);
+        if (p != v.end())
+        {
+            *p = v.back();
+            v.pop_back();
+        }
+        if (v.empty())
+            postings_.erase(it);
+    }
+
+public:
+    std::size_t size() const { return docs_.size(); }
+
+    /* Indexes key under text, replacing what it was indexed under before. */
+    void set(K key, std::string_view text)
+    {
+        static std::vector<std::uint32_t> now;
+
+        std::string folded = fold(text);
+        auto       &d      = docs_[key];
+
+        if (!d.grams.empty() && d.text == folded)
+            return;
+        grams(folded, now);
+        /* both lists are sorted, walk them together */
+        auto a = d.grams.begin(), b = now.begin();
+        while (a != d.grams.end() || b != now.end())
+            if (b == now.end() || (a != d.grams.end() && *a < *b))
+                unpost(*a++, key);
+            else if (a == d.grams.end() || *b < *a)
+                postings_[*b++].push_back(key);
+            else
+                ++a, ++b;
+        d.text = std::move(folded);
+        d.grams.swap(now);
+    }
+
+    void erase(K key)
+    {
+        auto it = docs_.find(key);
+        if (it == docs_.end())
+            return;
+        for (auto g : it->second.grams)
+            unpost(g, key);
+        docs_.erase(it);
+    }
+
+    /* Calls fn(key, text) for every text containing all words of query,
+     * text being the folded form. An empty query matches everything. */
+    template <typename Fn>
+    void query(std::string_view query, Fn fn) const
+    {
+        static std::vector<std::uint32_t> qgrams;
+
+        std::string                   q = fold(query);
+        std::vector<std::string_view> words;
+        std::vector<K> const         *best = nullptr;
+        std::size_t                   i, j;
+
+        for (i = 0; i < q.size(); i = j)
+        {
+            i = q.find_first_not_of(' ', i);
+            if (i == std::string::npos)
+                break;
+            j = std::min(q.find(' ', i), q.size());
+            words.push_back(std::string_view(q).substr(i, j - i));
+        }
+
+        for (auto w : words)
+        {
+            grams(w, qgrams);
+            for (auto g : qgrams)
+            {
+                auto it = postings_.find(g);
+                if (it == postings_.end())
+                    return;
+                if (!best || it->second.size() < best->size())
+                    best = &it->second;
+            }
+        }
+
+        auto match = [&](doc const &d)
+        {
+            for (auto w : words)
+                if (d.text.find(w) == std::string::npos)
+                    return false;
+            return true;
+        };
+
+        if (best)
+        {
+            for (auto const &key : *best)
+            {
+                auto const &d = docs_.find(key)->second;
+                if (match(d))
+                    fn(key, std::string_view(d.text));
+            }
+        }
+        else
+            for (auto const &[key, d] : docs_)
+                if (match(d))
+                    fn(key, std::string_view(d.text));
+    }
+};
+
+} // namespace zi
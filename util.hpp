@@ -4,7 +4,10 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
 #include <cstddef>
+#include <cstdint>
+#include <string_view>
 #include <type_traits>
 #include <utility>
 
@@ -34,6 +37,56 @@ inline T *safe_calloc(std::size_t size)
     return reinterpret_cast<T *>(p);
 }
 
+/* Plain window geometry; x/y is the top-left corner. */
+struct rect
+{
+    int x, y, w, h;
+
+    constexpr int cx() const noexcept { return x + w / 2; }
+    constexpr int cy() const noexcept { return y + h / 2; }
+
+    constexpr bool contains(int px, int py) const noexcept
+    {
+        return px >= x && px < x + w && py >= y && py < y + h;
+    }
+};
+
+/* Milliseconds on the monotonic clock, for deadlines in the event loop. */
+inline long long monotonic_ms()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* Microseconds on the same clock, for measuring short intervals. */
+inline long long monotonic_us()
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(steady_clock::now().time_since_epoch())
+        .count();
+}
+
+/* FNV-1a, for keying cached content on what it shows; chain calls by
+ * passing the previous result as the seed. */
+constexpr std::uint64_t fnv1a_seed = 14695981039346656037ull;
+
+constexpr inline std::uint64_t fnv1a(std::string_view s,
+                                     std::uint64_t    h = fnv1a_seed)
+{
+    for (unsigned char c : s)
+        h = (h ^ c) * 1099511628211ull;
+    return h;
+}
+
+constexpr inline std::uint64_t fnv1a(std::uint64_t v,
+                                     std::uint64_t h = fnv1a_seed)
+{
+    for (int i = 0; i < 8; ++i, v >>= 8)
+        h = (h ^ (v & 0xff)) * 1099511628211ull;
+    return h;
+}
+
 using ::die;
 
 } // namespace zi